@@ -37,7 +37,7 @@ public:
 
     void create(AggregateDataPtr place) override
     {
-        auto data = reinterpret_pointer_cast<int64_t[]>(place);
+        auto * data = reinterpret_cast<int64_t *>(place);
         if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::max)
         {
             data[0] = LLONG_MIN;
@@ -57,15 +57,12 @@ public:
         }
     }
 
-    void destroy(AggregateDataPtr place) override
-    {
-        (void)(place);
-        throw std::runtime_error("Not implemented");
-    }
+    /// State is trivially destructible.
+    void destroy(AggregateDataPtr) override { }
 
-    void add(AggregateDataPtr place, Row arguments) override
+    void add(AggregateDataPtr place, const Row & arguments) override
     {
-        auto data = std::reinterpret_pointer_cast<int64_t[]>(place);
+        auto * data = reinterpret_cast<int64_t *>(place);
         if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::max)
         {
             data[0] = std::max(data[0], std::get<int64_t>(arguments[0]));
@@ -85,9 +82,32 @@ public:
         }
     }
 
+    void merge(AggregateDataPtr place, AggregateDataPtr rhs) override
+    {
+        auto * data = reinterpret_cast<int64_t *>(place);
+        const auto * rhs_data = reinterpret_cast<const int64_t *>(rhs);
+        if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::max)
+        {
+            data[0] = std::max(data[0], rhs_data[0]);
+        }
+        else if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::min)
+        {
+            data[0] = std::min(data[0], rhs_data[0]);
+        }
+        else if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::avg)
+        {
+            data[0] += rhs_data[0];
+            data[1] += rhs_data[1];
+        }
+        else if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::sum)
+        {
+            data[0] += rhs_data[0];
+        }
+    }
+
     Value getResult(AggregateDataPtr place) override
     {
-        auto data = std::reinterpret_pointer_cast<int64_t[]>(place);
+        auto * data = reinterpret_cast<int64_t *>(place);
         if constexpr (AggregateFunctionType == SimpleAggregateFunctionType::avg)
         {
             return Value(data[0] / data[1]);
@@ -6,7 +6,8 @@
 namespace shdb
 {
 
-using AggregateDataPtr = std::shared_ptr<char[]>;
+/// Raw memory of getStateSize() bytes aligned to alignof(std::max_align_t), owned by the caller.
+using AggregateDataPtr = char *;
 
 class IAggregateFunction
 {
@@ -23,7 +24,10 @@ public:
 
     virtual void destroy(AggregateDataPtr place) = 0;
 
-    virtual void add(AggregateDataPtr place, Row arguments) = 0;
+    virtual void add(AggregateDataPtr place, const Row & arguments) = 0;
+
+    /// Combine state rhs into state place, as if all arguments added to rhs were added to place. rhs is left unchanged.
+    virtual void merge(AggregateDataPtr place, AggregateDataPtr rhs) = 0;
 
     virtual Value getResult(AggregateDataPtr place) = 0;
 
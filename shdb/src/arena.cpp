@@ -0,0 +1,20 @@
+#include "arena.h"
+
+#include <algorithm>
+
+namespace shdb
+{
+
+void Arena::addChunk(size_t min_size)
+{
+    static constexpr size_t MaxChunkSize = 128 * 1024 * 1024;
+
+    size_t size = std::max(next_chunk_size, min_size);
+    chunks.push_back(std::make_unique_for_overwrite<char[]>(size));
+    pos = chunks.back().get();
+    end = pos + size;
+    allocated_bytes += size;
+    next_chunk_size = std::min(next_chunk_size * 2, MaxChunkSize);
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace shdb
+{
+
+/** Bump allocator for many small objects that are freed all at once.
+  * Memory is taken from the system in chunks of geometrically growing size, so n allocations cost O(log n) system allocations.
+  * Nothing is freed and no destructors are run until the arena is destroyed.
+  */
+class Arena
+{
+public:
+    explicit Arena(size_t initial_chunk_size_ = 4096) : next_chunk_size(initial_chunk_size_) { }
+
+    Arena(const Arena &) = delete;
+    Arena & operator=(const Arena &) = delete;
+
+    /// alignment must be a power of two.
+    char * alloc(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        auto address = reinterpret_cast<uintptr_t>(pos);
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (!pos || padding + size > static_cast<size_t>(end - pos)) {
+            addChunk(size + alignment);
+            address = reinterpret_cast<uintptr_t>(pos);
+            padding = (alignment - address % alignment) % alignment;
+        }
+
+        char * result = pos + padding;
+        pos = result + size;
+        return result;
+    }
+
+    /// Bytes taken from the system.
+    size_t allocatedBytes() const { return allocated_bytes; }
+
+private:
+    void addChunk(size_t min_size);
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char * pos = nullptr;
+    char * end = nullptr;
+    size_t next_chunk_size;
+    size_t allocated_bytes = 0;
+};
+
+}
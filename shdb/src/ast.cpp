@@ -50,10 +50,24 @@ ASTPtr newOrder(ASTPtr expr, bool desc)
 }
 
 ASTPtr newSelectQuery(
-    ASTListPtr list, std::vector<std::string> from, ASTPtr where, ASTListPtr group_by, std::shared_ptr<IAST> having, ASTListPtr order)
+    ASTListPtr list,
+    std::vector<std::string> from,
+    ASTPtr where,
+    ASTListPtr group_by,
+    std::shared_ptr<IAST> having,
+    ASTListPtr order,
+    ASTPtr limit,
+    ASTPtr offset)
 {
     return std::make_shared<ASTSelectQuery>(
-        std::move(list), std::move(from), std::move(where), std::move(group_by), std::move(having), std::move(order));
+        std::move(list),
+        std::move(from),
+        std::move(where),
+        std::move(group_by),
+        std::move(having),
+        std::move(order),
+        std::move(limit),
+        std::move(offset));
 }
 
 ASTPtr newInsertQuery(std::string table, ASTListPtr values)
@@ -181,6 +195,10 @@ std::string toString(const IAST & ast)
                 result += " HAVING " + toString(*select_query.getHaving());
             if (select_query.getOrder())
                 result += " ORDER BY " + toString(*select_query.getOrder());
+            if (select_query.getLimit())
+                result += " LIMIT " + toString(*select_query.getLimit());
+            if (select_query.getOffset())
+                result += " OFFSET " + toString(*select_query.getOffset());
             return result;
         }
         case ASTType::insertQuery: {
@@ -197,7 +197,14 @@ class ASTSelectQuery : public IAST
 {
 public:
     ASTSelectQuery(
-        ASTListPtr projection, std::vector<std::string> from_, ASTPtr where, ASTListPtr group_by, ASTPtr having, ASTListPtr order)
+        ASTListPtr projection,
+        std::vector<std::string> from_,
+        ASTPtr where,
+        ASTListPtr group_by,
+        ASTPtr having,
+        ASTListPtr order,
+        ASTPtr limit = nullptr,
+        ASTPtr offset = nullptr)
         : IAST(ASTType::selectQuery), from(std::move(from_))
     {
         children.resize(children_size);
@@ -206,6 +213,8 @@ public:
         children[group_by_child_index] = std::move(group_by);
         children[having_child_index] = std::move(having);
         children[order_child_index] = std::move(order);
+        children[limit_child_index] = std::move(limit);
+        children[offset_child_index] = std::move(offset);
     }
 
     const ASTPtr & getProjection() const { return children[projection_child_index]; }
@@ -224,6 +233,12 @@ public:
 
     const ASTPtr & getOrder() const { return children[order_child_index]; }
 
+    /// Number literal or nullptr.
+    const ASTPtr & getLimit() const { return children[limit_child_index]; }
+
+    /// Number literal or nullptr.
+    const ASTPtr & getOffset() const { return children[offset_child_index]; }
+
     const std::vector<std::string> from;
 
 private:
@@ -232,7 +247,9 @@ private:
     static constexpr size_t group_by_child_index = 2;
     static constexpr size_t having_child_index = 3;
     static constexpr size_t order_child_index = 4;
-    static constexpr size_t children_size = order_child_index + 1;
+    static constexpr size_t limit_child_index = 5;
+    static constexpr size_t offset_child_index = 6;
+    static constexpr size_t children_size = offset_child_index + 1;
 };
 
 using ASTSelectQueryPtr = std::shared_ptr<ASTSelectQuery>;
@@ -301,7 +318,15 @@ ASTPtr newFunction(std::string name, ASTListPtr args);
 
 ASTPtr newOrder(ASTPtr expr, bool desc);
 
-ASTPtr newSelectQuery(ASTListPtr list, std::vector<std::string> from, ASTPtr where, ASTListPtr group_by, ASTPtr having, ASTListPtr order);
+ASTPtr newSelectQuery(
+    ASTListPtr list,
+    std::vector<std::string> from,
+    ASTPtr where,
+    ASTListPtr group_by,
+    ASTPtr having,
+    ASTListPtr order,
+    ASTPtr limit = nullptr,
+    ASTPtr offset = nullptr);
 
 ASTPtr newInsertQuery(std::string table, ASTListPtr values);
 
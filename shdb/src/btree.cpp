@@ -1,26 +1,55 @@
 #include "btree.h"
 #include "btree_page.h"
 
+#include <algorithm>
 #include <cassert>
+#include <limits>
 
 namespace shdb
 {
 
-BTree::BTree(const IndexMetadata & metadata_, Store & store_, std::optional<size_t> page_max_keys_size)
-    : IIndex(metadata_), metadata_page(nullptr)
+BTree::BTree(
+    const IndexMetadata & metadata_,
+    Store & store_,
+    std::optional<size_t> page_max_keys_size,
+    BTreeKeyFormat key_format,
+    bool allow_duplicate_keys)
+    : IIndex(metadata_), keys_with_row_id(allow_duplicate_keys), metadata_page(nullptr)
 {
+    /// Pages of an existing index can be read only after its metadata page tells the key format.
+    auto page_layout = std::make_shared<BTreePageLayout>();
+    index_table.setIndexTable(store_.createOrOpenIndexTable(metadata.getIndexName(), createBTreePageProvider(page_layout)));
+
+    bool initial_index_creation = index_table.getPageCount() == 0;
+    if (!initial_index_creation)
+    {
+        metadata_page = index_table.getMetadataPage(MetadataPageIndex);
+        key_format = metadata_page.getKeyFormat();
+        keys_with_row_id = metadata_page.getKeysWithRowId();
+    }
+
+    auto tree_key_schema = metadata.getKeySchema();
+    auto tree_key_marshal = metadata.getKeyMarshal();
+    if (keys_with_row_id)
+    {
+        tree_key_schema = std::make_shared<Schema>(*tree_key_schema);
+        tree_key_schema->emplace_back("row_id", Type::uint64, 0);
+        tree_key_marshal = std::make_shared<Marshal>(tree_key_schema);
+    }
+
+    auto key_codec = std::make_shared<BTreeKeyCodec>(tree_key_schema, tree_key_marshal, key_format);
+    uint32_t key_size_in_bytes = key_codec->getKeySizeInBytes();
+
     if (!page_max_keys_size)
     {
-        size_t internal_page_max_keys_size = BTreeInternalPage::calculateMaxKeysSize(metadata.fixedKeySizeInBytes());
-        size_t leaf_page_max_keys_size = BTreeLeafPage::calculateMaxKeysSize(metadata.fixedKeySizeInBytes());
+        size_t internal_page_max_keys_size = BTreeInternalPage::calculateMaxKeysSize(key_size_in_bytes);
+        size_t leaf_page_max_keys_size = BTreeLeafPage::calculateMaxKeysSize(key_size_in_bytes);
         page_max_keys_size = std::min(internal_page_max_keys_size, leaf_page_max_keys_size);
     }
 
     max_page_size = *page_max_keys_size;
-    auto page_provider = createBTreePageProvider(metadata.getKeyMarshal(), metadata.fixedKeySizeInBytes(), max_page_size);
-    index_table.setIndexTable(store_.createOrOpenIndexTable(metadata.getIndexName(), page_provider));
-
-    bool initial_index_creation = index_table.getPageCount() == 0;
+    page_layout->key_codec = std::move(key_codec);
+    page_layout->max_page_size = max_page_size;
 
     if (initial_index_creation)
     {
@@ -35,16 +64,16 @@ BTree::BTree(const IndexMetadata & metadata_, Store & store_, std::optional<size
         metadata_page = std::move(allocated_metadata_page);
         metadata_page.setRootPageIndex(root_page_index);
         metadata_page.setMaxPageSize(max_page_size);
-        metadata_page.setKeySizeInBytes(metadata.fixedKeySizeInBytes());
+        metadata_page.setKeySizeInBytes(key_size_in_bytes);
+        metadata_page.setKeyFormat(key_format);
+        metadata_page.setKeysWithRowId(keys_with_row_id);
         return;
     }
 
-    metadata_page = index_table.getMetadataPage(MetadataPageIndex);
-
-    if (metadata.fixedKeySizeInBytes() != metadata_page.getKeySizeInBytes())
+    if (key_size_in_bytes != metadata_page.getKeySizeInBytes())
         throw std::runtime_error(
             "BTree index inconsistency. Expected " + std::to_string(metadata_page.getKeySizeInBytes()) + " key size in bytes. Actual "
-            + std::to_string(metadata.fixedKeySizeInBytes()));
+            + std::to_string(key_size_in_bytes));
 
     if (max_page_size != metadata_page.getMaxPageSize())
         throw std::runtime_error(
@@ -198,7 +227,7 @@ ResponseInsert BTree::descend_insert(PageIndex node_index, const IndexKey & inde
         else 
         {
             size_t pos = internal_page.lookupWithIndex(resp.old_key).second;
-            if (compareRows(internal_page.getKey(pos), resp.old_key) == 0) 
+            if (internal_page.compareKey(pos, resp.old_key) == 0) 
             {
                 internal_page.setRow(pos, resp.new_key);
                 resp.skip = true;
@@ -259,18 +288,19 @@ ResponseRemove BTree::descend_remove(PageIndex node_index, const IndexKey & inde
 
         if (resp.remove_page)
         {
-            size_t pos = internal_page.lookup(resp.old_key);
+            size_t pos = internal_page.lookupWithIndex(resp.old_key).second;
             Row new_key = internal_page.removeKey(pos);
 
             resp.remove_page = internal_page.getSize() == 0;
-            resp.new_key = new_key;
+            /// Only removal of the first child changes the least key of the page.
+            resp.new_key = pos == 0 ? new_key : resp.old_key;
 
             return resp;
         }
         else 
         {
             size_t pos = internal_page.lookupWithIndex(resp.old_key).second;
-            if (compareRows(internal_page.getKey(pos), resp.old_key) == 0) 
+            if (internal_page.compareKey(pos, resp.old_key) == 0) 
             {
                 internal_page.setRow(pos, resp.new_key);
                 return resp;
@@ -292,7 +322,7 @@ void BTree::insert(const IndexKey & index_key, const RowId & row_id)
     PageIndex root_index = metadata_page.getRootPageIndex();
     BTreePagePtr root = index_table.getPage(root_index);
 
-    ResponseInsert resp = descend_insert(root_index, index_key, row_id);
+    ResponseInsert resp = descend_insert(root_index, makeTreeKey(index_key, row_id), row_id);
 
     if (resp.skip) {
         return;
@@ -308,24 +338,19 @@ void BTree::insert(const IndexKey & index_key, const RowId & row_id)
     }
 }
 
-bool BTree::remove(const IndexKey & index_key, const RowId &)
+bool BTree::remove(const IndexKey & index_key, const RowId & row_id)
 {
-    // std::cout << "\nREMOVE " << toString(index_key) << "\n\n";
     PageIndex root_index = metadata_page.getRootPageIndex();
-    BTreePagePtr root = index_table.getPage(root_index);
-    // dump(std::cout);
+    IndexKey tree_key = makeTreeKey(index_key, row_id);
 
-    std::vector<RowId> result;
-    lookup(index_key, result);
-    if (result.empty())
+    /// Without RowId in keys the entry is found by index key alone, so its RowId is checked separately.
+    auto row = lookupLeafPage(tree_key).lookup(tree_key);
+    if (!row || row->page_index != row_id.page_index || row->row_index != row_id.row_index)
     {
-        // std::cout << "EMPTY\n";
         return false;
     }
 
-    // std::cout << "REMOVING\n";
-
-    auto resp = descend_remove(root_index, index_key);
+    auto resp = descend_remove(root_index, tree_key);
 
     if (resp.remove_page) {
         auto [root_page, root_page_index] = index_table.allocateLeafPage();
@@ -335,35 +360,113 @@ bool BTree::remove(const IndexKey & index_key, const RowId &)
 
         metadata_page.setRootPageIndex(root_page_index);
     }
-    // std::cout << "\n\n";
-    // dump(std::cout);
 
     return true;
 }
 
 void BTree::lookup(const IndexKey & index_key, std::vector<RowId> & result)
 {
-    PageIndex index = metadata_page.getRootPageIndex();
+    IndexKey lower_bound = makeTreeKeyBound(index_key, false);
+    IndexKey upper_bound = makeTreeKeyBound(index_key, true);
 
-    while (true) {
-        BTreePagePtr page = index_table.getPage(index);
+    auto leaf_page = lookupLeafPage(lower_bound);
+    size_t pos = leaf_page.lowerBound(lower_bound);
 
-        if (page->isLeafPage()) 
+    /// Entries of index_key are the ones in [lower_bound, upper_bound], they may continue on the next leaf pages.
+    auto search_key = leaf_page.getRawPage()->getKeyCodec()->makeSearchKey(upper_bound);
+    while (true)
+    {
+        for (; pos < leaf_page.getSize(); ++pos)
         {
-            auto leaf_page = index_table.getLeafPage(index);
-            auto row = leaf_page.lookup(index_key);
-            if (row != std::nullopt)
+            if (leaf_page.compareKey(pos, search_key) > 0)
             {
-                result.push_back(*row);
+                return;
             }
+            result.push_back(leaf_page.getValue(pos));
+        }
+
+        PageIndex next_page_index = leaf_page.getNextPageIndex();
+        if (next_page_index == InvalidPageIndex)
+        {
             return;
         }
-        else 
+        leaf_page = index_table.getLeafPage(next_page_index);
+        pos = 0;
+    }
+}
+
+void BTree::bulkLoad(IIndexIterator & sorted_input, double fill_factor)
+{
+    if (fill_factor <= 0 || fill_factor > 1)
+        throw std::runtime_error("BTree fill factor must be in (0, 1]");
+
+    PageIndex root_index = metadata_page.getRootPageIndex();
+    if (!index_table.getPage(root_index)->isLeafPage() || index_table.getLeafPage(root_index).getSize() != 0)
+        throw std::runtime_error("BTree bulk load requires an empty index");
+
+    size_t page_fill_size = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(max_page_size) * fill_factor));
+
+    /// First key and page index of every page of the level being built.
+    std::vector<std::pair<IndexKey, PageIndex>> level;
+
+    auto leaf_page = index_table.getLeafPage(root_index);
+    PageIndex leaf_page_index = root_index;
+    std::optional<IndexKey> previous_key;
+    while (auto entry = sorted_input.nextRow())
+    {
+        IndexKey key = makeTreeKey(entry->first, entry->second);
+        const RowId & row_id = entry->second;
+        if (previous_key && compareRows(*previous_key, key) >= 0)
+            throw std::runtime_error("BTree bulk load input is not sorted by key and row id or has duplicate entries: " + toString(entry->first));
+
+        if (leaf_page.getSize() == page_fill_size)
+        {
+            auto [new_leaf_page, new_leaf_page_index] = index_table.allocateLeafPage();
+            new_leaf_page.setPreviousPageIndex(leaf_page_index);
+            new_leaf_page.setNextPageIndex(InvalidPageIndex);
+            leaf_page.setNextPageIndex(new_leaf_page_index);
+            leaf_page = new_leaf_page;
+            leaf_page_index = new_leaf_page_index;
+        }
+
+        if (leaf_page.getSize() == 0)
+            level.emplace_back(key, leaf_page_index);
+
+        leaf_page.append(key, row_id);
+        previous_key = std::move(key);
+    }
+
+    /// Internal pages get at least two children whenever the page capacity allows it, so each level is smaller
+    /// than the one below it. A last page that would get a single child takes it into the previous page if that
+    /// page has room, otherwise the previous page leaves two children for it.
+    size_t internal_page_fill_size = std::max<size_t>(2, page_fill_size);
+    while (level.size() > 1)
+    {
+        std::vector<std::pair<IndexKey, PageIndex>> upper_level;
+        for (size_t begin = 0; begin < level.size();)
         {
-            auto internal_page = index_table.getInternalPage(index);
-            index = internal_page.lookup(index_key);
+            size_t end = std::min(begin + internal_page_fill_size, level.size());
+            if (level.size() - end == 1)
+            {
+                if (end - begin < max_page_size)
+                    end += 1;
+                else if (end - begin > 2)
+                    end -= 1;
+            }
+
+            auto [internal_page, internal_page_index] = index_table.allocateInternalPage();
+            internal_page.insertFirstEntry(level[begin].second);
+            for (size_t j = begin + 1; j < end; ++j)
+                internal_page.appendEntry(level[j].first, level[j].second);
+
+            upper_level.emplace_back(std::move(level[begin].first), internal_page_index);
+            begin = end;
         }
+        level = std::move(upper_level);
     }
+
+    if (!level.empty())
+        metadata_page.setRootPageIndex(level.front().second);
 }
 
 namespace
@@ -398,6 +501,8 @@ public:
             IndexKey row = leaf_page.getKey(leaf_page_offset);
             RowId row_id = leaf_page.getValue(leaf_page_offset);
             leaf_page_offset += 1;
+            /// Drop RowId that follows index key in keys stored in pages.
+            row.resize(key_schema->size());
             if (isRowValid(row)) 
             {
                 return std::pair<IndexKey, RowId>(row, row_id);
@@ -516,10 +621,49 @@ void BTree::dump(std::ostream & stream)
     }
 }
 
-BTreeLeafPage BTree::lookupLeafPage(const IndexKey & index_key)
+IndexKey BTree::makeTreeKey(const IndexKey & index_key, const RowId & row_id) const
 {
-    (void)(index_key);
-    throw std::runtime_error("Not implemented");
+    if (!keys_with_row_id)
+        return index_key;
+
+    static_assert(sizeof(PageIndex) <= sizeof(uint32_t) && sizeof(RowIndex) <= sizeof(uint32_t));
+
+    /// Packed RowId compares as (page_index, row_index) does.
+    IndexKey tree_key = index_key;
+    tree_key.emplace_back((static_cast<uint64_t>(row_id.page_index) << 32) | static_cast<uint64_t>(row_id.row_index));
+    return tree_key;
+}
+
+IndexKey BTree::makeTreeKeyBound(const IndexKey & index_key, bool upper) const
+{
+    if (!keys_with_row_id)
+        return index_key;
+
+    IndexKey tree_key = index_key;
+    tree_key.emplace_back(upper ? std::numeric_limits<uint64_t>::max() : uint64_t{0});
+    return tree_key;
+}
+
+BTreeLeafPage BTree::lookupLeafPage(const IndexKey & tree_key)
+{
+    PageIndex page_index = metadata_page.getRootPageIndex();
+
+    while (true)
+    {
+        BTreePagePtr page = index_table.getPage(page_index);
+
+        if (page->isLeafPage())
+        {
+            return index_table.getLeafPage(page_index);
+        }
+        else if (page->isInternalPage())
+        {
+            page_index = index_table.getInternalPage(page_index).lookup(tree_key);
+        }
+        else {
+            throw std::runtime_error("Unexpected page type");
+        }
+    }
 }
 
 BTreeLeafPage BTree::lookupLeftmostLeafPage()
@@ -545,14 +689,15 @@ BTreeLeafPage BTree::lookupLeftmostLeafPage()
     }
 }
 
-BTreePtr BTree::createIndex(const IndexMetadata & index_metadata, Store & store)
+BTreePtr BTree::createIndex(const IndexMetadata & index_metadata, Store & store, BTreeKeyFormat key_format, bool allow_duplicate_keys)
 {
-    return std::shared_ptr<BTree>(new BTree(index_metadata, store, {}));
+    return std::shared_ptr<BTree>(new BTree(index_metadata, store, {}, key_format, allow_duplicate_keys));
 }
 
-BTreePtr BTree::createIndex(const IndexMetadata & index_metadata, size_t page_max_keys_size, Store & store)
+BTreePtr BTree::createIndex(
+    const IndexMetadata & index_metadata, size_t page_max_keys_size, Store & store, BTreeKeyFormat key_format, bool allow_duplicate_keys)
 {
-    return std::shared_ptr<BTree>(new BTree(index_metadata, store, page_max_keys_size));
+    return std::shared_ptr<BTree>(new BTree(index_metadata, store, page_max_keys_size, key_format, allow_duplicate_keys));
 }
 
 void BTree::removeIndex(const std::string & name_, Store & store)
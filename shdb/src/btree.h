@@ -84,9 +84,21 @@ private:
 class BTree : public IIndex
 {
 public:
-    static BTreePtr createIndex(const IndexMetadata & index_metadata, Store & store);
-
-    static BTreePtr createIndex(const IndexMetadata & index_metadata, size_t page_max_keys_size, Store & store);
+    /** key_format and allow_duplicate_keys are used when the index is created, an existing index is opened as it was created.
+      * An index with duplicate keys stores RowId after every key, so its keys are wider and its pages hold fewer of them.
+      */
+    static BTreePtr createIndex(
+        const IndexMetadata & index_metadata,
+        Store & store,
+        BTreeKeyFormat key_format = BTreeKeyFormat::row,
+        bool allow_duplicate_keys = false);
+
+    static BTreePtr createIndex(
+        const IndexMetadata & index_metadata,
+        size_t page_max_keys_size,
+        Store & store,
+        BTreeKeyFormat key_format = BTreeKeyFormat::row,
+        bool allow_duplicate_keys = false);
 
     ResponseInsert descend_insert(PageIndex node_index, const IndexKey & index_key, const RowId & row_id);
 
@@ -102,8 +114,17 @@ public:
 
     bool remove(const IndexKey & index_key, const RowId & row_id) override;
 
+    /// Append row ids of all entries with index_key to result, in ascending row id order.
     void lookup(const IndexKey & index_key, std::vector<RowId> & result) override;
 
+    /** Build the tree bottom up from (key, row id) pairs in ascending key order, e.g. an external sort of a table scan.
+      * Pairs with equal keys must follow in ascending row id order.
+      * Leaf pages are filled one after another to fill_factor of their capacity and linked, then every level
+      * of internal pages is built from the first keys of the level below, until a single root is left.
+      * Every page is written once and no page is split. The index must be empty.
+      */
+    void bulkLoad(IIndexIterator & sorted_input, double fill_factor = 1.0);
+
     std::unique_ptr<IIndexIterator> read() override;
 
     std::unique_ptr<IIndexIterator> read(const KeyConditions & predicates) override;
@@ -119,14 +140,29 @@ public:
     static constexpr PageIndex MetadataPageIndex = 0;
 
 private:
-    BTreeLeafPage lookupLeafPage(const IndexKey & index_key);
+    /// Key stored in pages for entry of index_key and row_id.
+    IndexKey makeTreeKey(const IndexKey & index_key, const RowId & row_id) const;
+
+    /// Least or greatest key stored in pages that an entry of index_key can have.
+    IndexKey makeTreeKeyBound(const IndexKey & index_key, bool upper) const;
+
+    /// Leaf page that contains tree_key if it is in the tree.
+    BTreeLeafPage lookupLeafPage(const IndexKey & tree_key);
 
     BTreeLeafPage lookupLeftmostLeafPage();
 
-    BTree(const IndexMetadata & metadata_, Store & store, std::optional<size_t> page_max_keys_size);
+    BTree(
+        const IndexMetadata & metadata_,
+        Store & store,
+        std::optional<size_t> page_max_keys_size,
+        BTreeKeyFormat key_format,
+        bool allow_duplicate_keys);
 
     size_t max_page_size = 0;
 
+    /// Keys stored in pages are index keys followed by RowId, see BTreeMetadataPage.
+    bool keys_with_row_id = false;
+
     BTreeIndexTable index_table;
 
     BTreeMetadataPage metadata_page;
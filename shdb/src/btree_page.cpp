@@ -1,5 +1,7 @@
 #include "btree_page.h"
 
+#include "key_encoding.h"
+
 namespace shdb
 {
 
@@ -9,22 +11,15 @@ namespace
 class BTreePageProvider : public IPageProvider
 {
 public:
-    explicit BTreePageProvider(std::shared_ptr<Marshal> marshal_, uint32_t key_size_in_bytes_, uint32_t max_page_size_)
-        : marshal(std::move(marshal_)), key_size_in_bytes(key_size_in_bytes_), max_page_size(max_page_size_)
-    {
-    }
+    explicit BTreePageProvider(std::shared_ptr<const BTreePageLayout> layout_) : layout(std::move(layout_)) { }
 
     std::shared_ptr<IPage> getPage(std::shared_ptr<Frame> frame) override
     {
-        return std::make_shared<BTreePage>(frame, marshal, key_size_in_bytes, max_page_size);
+        return std::make_shared<BTreePage>(frame, layout->key_codec, layout->max_page_size);
     }
 
-    const uint32_t key_size_in_bytes;
-
-    const uint32_t max_page_size;
-
 private:
-    std::shared_ptr<Marshal> marshal;
+    std::shared_ptr<const BTreePageLayout> layout;
 };
 
 }
@@ -46,9 +41,83 @@ std::string toString(BTreePageType page_type)
     return {};
 }
 
-std::shared_ptr<IPageProvider> createBTreePageProvider(std::shared_ptr<Marshal> marshal, uint32_t key_size_in_bytes, uint32_t max_page_size)
+std::string toString(BTreeKeyFormat key_format)
+{
+    switch (key_format)
+    {
+        case BTreeKeyFormat::row:
+            return "Row";
+        case BTreeKeyFormat::normalized:
+            return "Normalized";
+    }
+
+    return "Unknown";
+}
+
+BTreeKeyCodec::BTreeKeyCodec(std::shared_ptr<Schema> key_schema_, std::shared_ptr<Marshal> marshal_, BTreeKeyFormat key_format_)
+    : key_schema(std::move(key_schema_)), marshal(std::move(marshal_)), key_format(key_format_)
+{
+    switch (key_format)
+    {
+        case BTreeKeyFormat::row:
+            key_size_in_bytes = marshal->getFixedRowSpace();
+            break;
+        case BTreeKeyFormat::normalized:
+            key_size_in_bytes = 0;
+            for (const auto & column : *key_schema)
+                key_size_in_bytes += getFixedNormalizedValueSize(column);
+            /// Zero padding keeps values that follow keys in entries aligned and doesn't change the order.
+            key_size_in_bytes = (key_size_in_bytes + alignof(RowId) - 1) / alignof(RowId) * alignof(RowId);
+            break;
+        default:
+            throw std::runtime_error("Unknown BTree key format " + std::to_string(static_cast<uint32_t>(key_format)));
+    }
+}
+
+Row BTreeKeyCodec::deserialize(uint8_t * data) const
+{
+    if (key_format == BTreeKeyFormat::row)
+        return marshal->deserializeRow(data);
+
+    Row key;
+    const uint8_t * position = data;
+    for (const auto & column : *key_schema)
+        key.push_back(readFixedNormalizedValue(position, column));
+    return key;
+}
+
+void BTreeKeyCodec::serialize(uint8_t * data, const Row & key) const
+{
+    if (key_format == BTreeKeyFormat::row)
+    {
+        marshal->serializeRow(data, key);
+        return;
+    }
+
+    auto search_key = makeSearchKey(key);
+    memcpy(data, search_key.normalized.data(), key_size_in_bytes);
+}
+
+BTreeSearchKey BTreeKeyCodec::makeSearchKey(const Row & key) const
+{
+    BTreeSearchKey search_key;
+    if (key_format == BTreeKeyFormat::row)
+    {
+        search_key.row = key;
+    }
+    else
+    {
+        search_key.normalized.reserve(key_size_in_bytes);
+        for (size_t i = 0; i < key_schema->size(); ++i)
+            appendFixedNormalizedValue(search_key.normalized, key[i], (*key_schema)[i]);
+        search_key.normalized.resize(key_size_in_bytes, '\0');
+    }
+    return search_key;
+}
+
+std::shared_ptr<IPageProvider> createBTreePageProvider(std::shared_ptr<const BTreePageLayout> layout)
 {
-    return std::make_shared<BTreePageProvider>(std::move(marshal), key_size_in_bytes, max_page_size);
+    return std::make_shared<BTreePageProvider>(std::move(layout));
 }
 
 }
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 
 #include "bufferpool.h"
 #include "comparator.h"
@@ -25,12 +26,72 @@ enum BTreePageType : uint32_t
 
 std::string toString(BTreePageType page_type);
 
+enum class BTreeKeyFormat : uint32_t
+{
+    /// Keys are serialized by Marshal of the key schema and compared column by column.
+    row = 0,
+    /// Keys are fixed size normalized keys (see appendFixedNormalizedValue) compared with memcmp.
+    normalized = 1
+};
+
+std::string toString(BTreeKeyFormat key_format);
+
+/// Key of one search, encoded once for all comparisons of the search.
+/// Only the field of the key format of the index is set, row for BTreeKeyFormat::row, normalized otherwise.
+struct BTreeSearchKey
+{
+    Row row;
+    std::string normalized;
+};
+
+/// Reads, writes and compares keys stored in pages of one index in its key format.
+class BTreeKeyCodec
+{
+public:
+    BTreeKeyCodec(std::shared_ptr<Schema> key_schema_, std::shared_ptr<Marshal> marshal_, BTreeKeyFormat key_format_);
+
+    BTreeKeyFormat getKeyFormat() const { return key_format; }
+
+    uint32_t getKeySizeInBytes() const { return key_size_in_bytes; }
+
+    Row deserialize(uint8_t * data) const;
+
+    void serialize(uint8_t * data, const Row & key) const;
+
+    BTreeSearchKey makeSearchKey(const Row & key) const;
+
+    /// Compare key stored at data with search key, as compareRows does.
+    int16_t compare(const uint8_t * data, const BTreeSearchKey & key) const
+    {
+        if (key_format == BTreeKeyFormat::row)
+            return marshal->compareWithRow(data, key.row);
+
+        int result = memcmp(data, key.normalized.data(), key_size_in_bytes);
+        return static_cast<int16_t>((result > 0) - (result < 0));
+    }
+
+private:
+    std::shared_ptr<Schema> key_schema;
+    std::shared_ptr<Marshal> marshal;
+    BTreeKeyFormat key_format;
+    uint32_t key_size_in_bytes;
+};
+
+/// Key codec and page capacity of one index, known once its metadata page is read.
+struct BTreePageLayout
+{
+    std::shared_ptr<const BTreeKeyCodec> key_codec;
+    uint32_t max_page_size = 0;
+};
+
 class BTreePage : public IPage
 {
 public:
-    explicit BTreePage(
-        std::shared_ptr<Frame> frame_, std::shared_ptr<Marshal> marshal_, uint32_t key_size_in_bytes_, uint32_t max_page_size_)
-        : frame(std::move(frame_)), marshal(std::move(marshal_)), key_size_in_bytes(key_size_in_bytes_), max_page_size(max_page_size_)
+    explicit BTreePage(std::shared_ptr<Frame> frame_, std::shared_ptr<const BTreeKeyCodec> key_codec_, uint32_t max_page_size_)
+        : key_size_in_bytes(key_codec_ ? key_codec_->getKeySizeInBytes() : 0)
+        , max_page_size(max_page_size_)
+        , frame(std::move(frame_))
+        , key_codec(std::move(key_codec_))
     {
     }
 
@@ -40,7 +101,7 @@ public:
 
     std::shared_ptr<Frame> & getFrame() { return frame; }
 
-    const std::shared_ptr<Marshal> & getMarshal() const { return marshal; }
+    const std::shared_ptr<const BTreeKeyCodec> & getKeyCodec() const { return key_codec; }
 
     BTreePageType getPageType() const { return getValue<BTreePageType>(0); }
 
@@ -93,7 +154,7 @@ public:
 
 private:
     std::shared_ptr<Frame> frame;
-    std::shared_ptr<Marshal> marshal;
+    std::shared_ptr<const BTreeKeyCodec> key_codec;
 };
 
 using BTreePagePtr = std::shared_ptr<BTreePage>;
@@ -102,9 +163,13 @@ using BTreePagePtr = std::shared_ptr<BTreePage>;
   * Contains necessary metadata information for btree index startup.
   *
   * Header format:
-  * --------------------------------------------------------------------------
-  * | PageType (4) | RootPageIndex (4) | KeySizeInBytes (4) | MaxPageSize(4) |
-  * --------------------------------------------------------------------------
+  * --------------------------------------------------------------------------------------------
+  * | PageType (4) | RootPageIndex (4) | KeySizeInBytes (4) | MaxPageSize(4) | KeyFormat (4) | KeysWithRowId (4) |
+  * --------------------------------------------------------------------------------------------------------------
+  *
+  * KeyFormat is zero, that is BTreeKeyFormat::row, in indexes created before it was introduced.
+  * KeysWithRowId is non zero if keys stored in pages are index keys followed by RowId, so that duplicate index keys
+  * are distinct keys in the tree. It is zero in unique indexes, including all indexes created before it was introduced.
   */
 class BTreeMetadataPage
 {
@@ -119,6 +184,10 @@ public:
 
     static constexpr size_t MaxPageSizeHeaderOffset = 2;
 
+    static constexpr size_t KeyFormatHeaderOffset = 3;
+
+    static constexpr size_t KeysWithRowIdHeaderOffset = 4;
+
     const BTreePagePtr & getRawPage() const { return page; }
 
     PageIndex getRootPageIndex() const { return page->getValue<PageIndex>(RootPageIndexHeaderOffset, BTreePage::HeaderOffset); }
@@ -139,6 +208,17 @@ public:
 
     void setMaxPageSize(uint32_t max_page_size) { page->setValue(MaxPageSizeHeaderOffset, max_page_size, BTreePage::HeaderOffset); }
 
+    BTreeKeyFormat getKeyFormat() const { return page->getValue<BTreeKeyFormat>(KeyFormatHeaderOffset, BTreePage::HeaderOffset); }
+
+    void setKeyFormat(BTreeKeyFormat key_format) { page->setValue(KeyFormatHeaderOffset, key_format, BTreePage::HeaderOffset); }
+
+    bool getKeysWithRowId() const { return page->getValue<uint32_t>(KeysWithRowIdHeaderOffset, BTreePage::HeaderOffset) != 0; }
+
+    void setKeysWithRowId(bool keys_with_row_id)
+    {
+        page->setValue<uint32_t>(KeysWithRowIdHeaderOffset, keys_with_row_id, BTreePage::HeaderOffset);
+    }
+
     std::ostream & dump(std::ostream & stream, size_t offset = 0) const
     {
         std::string offset_string(offset, ' ');
@@ -146,6 +226,8 @@ public:
         stream << offset_string << "Root page index " << getRootPageIndex() << '\n';
         stream << offset_string << "Key size in bytes " << getKeySizeInBytes() << '\n';
         stream << offset_string << "Max page size " << getMaxPageSize() << '\n';
+        stream << offset_string << "Key format " << toString(getKeyFormat()) << '\n';
+        stream << offset_string << "Keys with row id " << getKeysWithRowId() << '\n';
 
         return stream;
     }
@@ -197,20 +279,20 @@ public:
 
     void decreaseSize(uint32_t amount) { page->getValue<uint32_t>(CurrentSizeHeaderIndex, BTreePage::HeaderOffset) -= amount; }
 
+    /** Remove entry at index. Return the new least key of the page if the first entry was removed,
+      * otherwise an empty row.
+      */
     Row removeKey(size_t index) 
     {
         Row row;
-
-        for (size_t i = index + 1; i < getSize(); ++i)
-        {
-            if (i == 1) {
-                row = getKey(i);
-                setValue(0, getValue(i));
-            }
-            else {
-                setEntry(i - 1, getKey(i), getValue(i));
-            }
+        if (index == 0 && getSize() > 1) {
+            /// Invalid key stays in place, only child page index of the first entry is replaced.
+            row = getKey(1);
+            setValue(0, getValue(1));
+            index = 1;
         }
+
+        moveEntries(index + 1, index, getSize() - index - 1);
         decreaseSize(1);
 
         return row;
@@ -218,11 +300,15 @@ public:
 
     Row getKey(size_t index) const
     {
-        std::cout << "INDEX " << index << '\n';
         uint8_t * data = getEntryStartOffset(index);
-        return page->getMarshal()->deserializeRow(data);
+        return page->getKeyCodec()->deserialize(data);
     }
 
+    /// Compare key at index with key without deserializing it
+    int16_t compareKey(size_t index, const BTreeSearchKey & key) const { return page->getKeyCodec()->compare(getEntryStartOffset(index), key); }
+
+    int16_t compareKey(size_t index, const Row & key) const { return compareKey(index, page->getKeyCodec()->makeSearchKey(key)); }
+
     PageIndex getValue(size_t index) const
     {
         size_t offset = HeaderOffset + getEntrySize() * index + page->key_size_in_bytes;
@@ -240,7 +326,7 @@ public:
     void setRow(size_t index,  const Row & row) 
     {
         uint8_t * data = getEntryStartOffset(index);
-        page->getMarshal()->serializeRow(data, row);
+        page->getKeyCodec()->serialize(data, row);
     }
 
     /// Set key and value for specified index
@@ -257,25 +343,18 @@ public:
         increaseSize(1);
     }
 
+    /// Insert key and value after the last entry, key must be greater than all keys in page
+    void appendEntry(const Row & key, const PageIndex & value)
+    {
+        setEntry(getSize(), key, value);
+        increaseSize(1);
+    }
+
     /// Insert key and value for specified index
     bool insertEntry(size_t index, const Row & key, const PageIndex & value)
     {
-        Row new_key = key;
-        PageIndex new_value = value;
-
-        while (index < getSize()) {
-            Row old_key = getKey(index);
-            PageIndex old_value = getValue(index);
-
-            setEntry(index, new_key, new_value);
-
-            new_key = old_key;
-            new_value = old_value;
-
-            ++index;
-        }
-
-        setEntry(index, new_key, new_value);
+        moveEntries(index, index + 1, getSize() - index);
+        setEntry(index, key, value);
 
         increaseSize(1);
 
@@ -285,12 +364,13 @@ public:
     /// Lookup specified key in page
     std::pair<PageIndex, size_t> lookupWithIndex(const Row & key) const
     {
+        auto search_key = page->getKeyCodec()->makeSearchKey(key);
         size_t l = 0;
         size_t r = getSize() - 1;
 
         while (l < r) {
             size_t mid = (l + r + 1) / 2;
-            auto comp_val = compareRows(getKey(mid), key);
+            auto comp_val = compareKey(mid, search_key);
             if (comp_val <= 0) {
                 l = mid;
             } else {
@@ -309,18 +389,15 @@ public:
       */
     Row split(BTreeInternalPage & rhs_page)
     {
-        size_t counter = 1;
-        size_t first_index =  getSize() / 2;
+        size_t first_index = getSize() / 2;
+        size_t count = getSize() - first_index;
         Row first_row_in_new_page = getKey(first_index);
-        rhs_page.insertFirstEntry(getValue(first_index));
 
-        for (size_t i = first_index + 1; i < getSize(); ++i) 
-        {
-            rhs_page.insertEntry(counter, getKey(i), getValue(i));
-            counter += 1;
-        }
-        
-        decreaseSize(counter);
+        /// Key of the first moved entry is not copied, it becomes the invalid key of rhs_page.
+        rhs_page.insertFirstEntry(getValue(first_index));
+        memcpy(rhs_page.getEntryStartOffset(1), getEntryStartOffset(first_index + 1), (count - 1) * getEntrySize());
+        rhs_page.increaseSize(count - 1);
+        decreaseSize(count);
 
         return first_row_in_new_page;
     }
@@ -350,10 +427,17 @@ private:
 
     inline size_t getEntrySize() const { return page->key_size_in_bytes + sizeof(PageIndex); }
 
+    /// Move count entries starting at index from to index to, ranges may overlap
+    void moveEntries(size_t from, size_t to, size_t count)
+    {
+        memmove(getEntryStartOffset(to), getEntryStartOffset(from), count * getEntrySize());
+    }
+
     BTreePagePtr page;
 };
 
-/** Store indexed key and value. Only support unique key.
+/** Store indexed key and value. Keys are unique within the page, BTree makes duplicate index keys unique
+  * by storing them followed by RowId.
   *
   *  Header format (size in byte, 4 * 4 = 16 bytes in total):
   *  ------------------------------------------------------------------------
@@ -411,9 +495,14 @@ public:
     Row getKey(size_t index) const
     {
         uint8_t * data = getEntryStartOffset(index);
-        return page->getMarshal()->deserializeRow(data);
+        return page->getKeyCodec()->deserialize(data);
     }
 
+    /// Compare key at index with key without deserializing it
+    int16_t compareKey(size_t index, const BTreeSearchKey & key) const { return page->getKeyCodec()->compare(getEntryStartOffset(index), key); }
+
+    int16_t compareKey(size_t index, const Row & key) const { return compareKey(index, page->getKeyCodec()->makeSearchKey(key)); }
+
     RowId getValue(size_t index) const
     {
         size_t offset = HeaderOffset + getEntrySize() * index + page->key_size_in_bytes;
@@ -429,7 +518,7 @@ public:
     Row getMinKey() const
     {
         uint8_t * data = getEntryStartOffset(0);
-        return page->getMarshal()->deserializeRow(data);
+        return page->getKeyCodec()->deserialize(data);
     }
 
     RowId getMaxValue() const
@@ -441,13 +530,13 @@ public:
     Row getMaxKey() const
     {
         uint8_t * data = getEntryStartOffset(getSize() - 1);
-        return page->getMarshal()->deserializeRow(data);
+        return page->getKeyCodec()->deserialize(data);
     }
 
     void setKey(Row & key, size_t index) const 
     {
         uint8_t * data = getEntryStartOffset(index);
-        page->getMarshal()->serializeRow(data, key);
+        page->getKeyCodec()->serialize(data, key);
     }
 
     void setValue(RowId & value, size_t index) const 
@@ -456,6 +545,13 @@ public:
         page->setValue<RowId>(0, value, offset);
     }
 
+    /// Insert key and value after the last entry, key must be greater than all keys in page
+    void append(const Row & key, const RowId & value)
+    {
+        setEntry(getSize(), key, value);
+        increaseSize(1);
+    }
+
     /// Insert specified key and value in page
     bool insert(const Row & key, const RowId & value)
     {
@@ -465,28 +561,12 @@ public:
 
         size_t index = lowerBound(key);
 
-        if (index != getSize() && compareRows(key, getKey(index)) == 0) {
-            throw "Key " + toString(key) + " already exists";
+        if (index != getSize() && compareKey(index, key) == 0) {
+            throw std::runtime_error("Key " + toString(key) + " already exists");
         }
 
-        Row new_key = key;
-        RowId new_value = value;
-
-        while (index < getSize()) {
-            Row old_key = getKey(index);
-            RowId old_value = getValue(index);
-
-            setKey(new_key, index);
-            setValue(new_value, index);
-
-            new_key = old_key;
-            new_value = old_value;
-
-            ++index;
-        }
-
-        setKey(new_key, index);
-        setValue(new_value, index);
+        moveEntries(index, index + 1, getSize() - index);
+        setEntry(index, key, value);
 
         increaseSize(1);
 
@@ -497,7 +577,7 @@ public:
     std::optional<RowId> lookup(const Row & key) const
     {
         size_t pos = lowerBound(key);
-        if (pos == getSize() || compareRows(getKey(pos), key) != 0) {
+        if (pos == getSize() || compareKey(pos, key) != 0) {
             return std::nullopt;
         }
 
@@ -507,12 +587,13 @@ public:
     /// Return index of lower bound for specified key
     size_t lowerBound(const Row & key) const
     {
+        auto search_key = page->getKeyCodec()->makeSearchKey(key);
         size_t l = 0;
         size_t r = getSize();
 
         while (l < r) {
             size_t mid = (l + r) / 2;
-            auto comp_val = compareRows(getKey(mid), key);
+            auto comp_val = compareKey(mid, search_key);
             if (comp_val == -1) {
                 l = mid + 1;
             } else {
@@ -534,36 +615,27 @@ public:
 
         size_t pos = lowerBound(key);
 
-        if (pos == size || compareRows(getKey(pos), key) != 0) {
+        if (pos == size || compareKey(pos, key) != 0) {
             return false;
         }
 
-        pos += 1;
-
-        while (pos < size) {
-            Row new_key = getKey(pos);
-            RowId new_val =  getValue(pos);
-            setKey(new_key, pos - 1);
-            setValue(new_val, pos - 1);
-            pos += 1;
-        }
-
+        moveEntries(pos + 1, pos, size - pos - 1);
         decreaseSize(1);
 
         return true;
     }
 
-    /** Split current page and move top half of keys to rhs_page.
+    /** Split current page and move top half of keys to empty rhs_page.
       * Return top key.
       */
     Row split(BTreeLeafPage & rhs_page)
     {
-        for (size_t i = getSize() / 2; i < getSize(); ++i) 
-        {
-            rhs_page.insert(getKey(i), getValue(i));
-        }
+        size_t first_index = getSize() / 2;
+        size_t count = getSize() - first_index;
 
-        this->decreaseSize(getSize() - (getSize() / 2));
+        memcpy(rhs_page.getEntryStartOffset(rhs_page.getSize()), getEntryStartOffset(first_index), count * getEntrySize());
+        rhs_page.increaseSize(count);
+        decreaseSize(count);
 
         return rhs_page.getMinKey();
     }
@@ -613,10 +685,23 @@ private:
 
     inline size_t getEntrySize() const { return page->key_size_in_bytes + sizeof(RowId); }
 
+    void setEntry(size_t index, const Row & key, const RowId & value)
+    {
+        page->getKeyCodec()->serialize(getEntryStartOffset(index), key);
+        size_t offset = HeaderOffset + getEntrySize() * index + page->key_size_in_bytes;
+        page->setValue<RowId>(0, value, offset);
+    }
+
+    /// Move count entries starting at index from to index to, ranges may overlap
+    void moveEntries(size_t from, size_t to, size_t count)
+    {
+        memmove(getEntryStartOffset(to), getEntryStartOffset(from), count * getEntrySize());
+    }
+
     BTreePagePtr page;
 };
 
-std::shared_ptr<IPageProvider>
-createBTreePageProvider(std::shared_ptr<Marshal> marshal, uint32_t key_size_in_bytes, uint32_t max_page_size);
+/// Pages get the key codec and max page size layout has at the time they are read.
+std::shared_ptr<IPageProvider> createBTreePageProvider(std::shared_ptr<const BTreePageLayout> layout);
 
 }
@@ -1,92 +1,219 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <unordered_map>
+#include <utility>
 #include <iostream>
 
+#include "replacement_policy.h"
+
 namespace shdb
 {
 
+/** Cache over a fixed set of values (frames), by default with clock replacement.
+  * Every slot remembers the key it currently holds, so eviction,
+  * lookup and (un)locking never have to scan the key map.
+  * Values are pinned with lock and released with unlock, a value is evictable only when
+  * every lock has been matched by an unlock. Not thread-safe, see ShardedClockCache.
+  */
 template <class Key, class Value>
 class ClockCache
 {
 public:
-    explicit ClockCache(std::vector<Value> free_values) : myclock(free_values)
+    explicit ClockCache(std::vector<Value> free_values, ReplacementPolicyType policy_type = ReplacementPolicyType::clock)
+        : pins(free_values.size()), policy(createReplacementPolicy<Key>(policy_type, free_values.size()))
     {
+        for (auto & value : free_values) {
+            cells.emplace_back(value);
+        }
+        for (size_t slot = cells.size(); slot > 0; --slot) {
+            free_slots.push_back(slot - 1);
+        }
     }
 
     std::pair<bool, Value> find(const Key & key)
     {
-        if (!myclock.values.contains(key)) {
+        auto it = values.find(key);
+        if (it == values.end()) {
             return {false, 0};
         }
 
-        auto index = myclock.values[key];
-        myclock.ring[index].amount = std::min(5, myclock.ring[index].amount + 1);
-        return {true, myclock.ring[index].value};
+        policy->onHit(it->second);
+        return {true, cells[it->second].value};
     }
 
     Value put(const Key & key)
     {
-        while (true) {
-            if (myclock.ring[time].amount > 0) 
-            {
-                    myclock.ring[time].amount -= 1;
-            }
-            else if (myclock.ring[time].amount == 0 && !myclock.ring[time].lock) 
-            {
-                for (auto &  [key, val] : myclock.values) {
-                    if (val == time) {
-                        myclock.values.erase(key);
-                        break;
-                    }
-                }
-                myclock.values[key] = time;
-                myclock.ring[time].amount = 1;
-                return myclock.ring[time].value;
-            }
+        /// The value already assigned to key is reassigned to it in place, so its slot never holds a stale key.
+        auto it = values.find(key);
+        if (it != values.end()) {
+            auto & cell = cells[it->second];
+            cell.generation += 1;
+            policy->onHit(it->second);
+            return cell.value;
+        }
 
-            time++;
-            time %= myclock.ring.size();
+        size_t slot;
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            auto victim = policy->pickVictim(pins);
+            if (!victim) {
+                throw std::runtime_error("All cache values are locked");
+            }
+            slot = *victim;
+            values.erase(*cells[slot].key);
+            policy->onEvict(slot, *cells[slot].key);
         }
+
+        auto & cell = cells[slot];
+        cell.key = key;
+        cell.generation += 1;
+        values[key] = slot;
+        policy->onInsert(slot, key);
+        return cell.value;
     }
 
     void lock(const Key & key)
     {
-        auto index = myclock.values[key];
-        myclock.ring[index].lock = true;
+        auto it = values.find(key);
+        if (it != values.end()) {
+            pins[it->second] += 1;
+        }
     }
 
     void unlock(const Key & key)
     {
-        auto index = myclock.values[key];
-        myclock.ring[index].lock = false;
+        auto it = values.find(key);
+        if (it != values.end() && pins[it->second] > 0) {
+            pins[it->second] -= 1;
+        }
+    }
+
+    /// Find key or put it if absent, and lock the resulting value in one step.
+    /// Returns true if key was already cached.
+    std::pair<bool, Value> findOrPutLocked(const Key & key)
+    {
+        auto result = find(key);
+        if (!result.first) {
+            result.second = put(key);
+        }
+        lock(key);
+        return result;
+    }
+
+    size_t size() const { return cells.size(); }
+
+    /// Number of times the value holding key has been reassigned, lets holders detect reuse.
+    uint64_t generation(const Key & key)
+    {
+        auto it = values.find(key);
+        return it != values.end() ? cells[it->second].generation : 0;
     }
 
 private:
     struct Cell {
-        Cell(Value value)
+        explicit Cell(Value value_) : value(std::move(value_))
         {
-            this->value = value;
         }
         Value value;
-        int amount = 0;
-        bool lock = false;
+        std::optional<Key> key;
+        uint64_t generation = 0;
     };
 
-    struct MyClock {
-        MyClock(std::vector<Value> & free_values) {
-            for (auto & value : free_values) {
-                ring.push_back({Cell(value)});
-            }
+    std::vector<Cell> cells;
+    std::vector<int> pins;
+    std::vector<size_t> free_slots;
+    std::unordered_map<Key, size_t> values;
+    ReplacementPolicyPtr<Key> policy;
+};
+
+/** Thread-safe clock cache split into independent shards.
+  * Keys are assigned to shards by hash and values are spread over shards round-robin,
+  * every shard is a ClockCache with its own mutex, so queries touching different shards never contend.
+  * put throws if every value of the key's shard is locked, even if other shards have free values.
+  */
+template <class Key, class Value, class Hash = std::hash<Key>>
+class ShardedClockCache
+{
+public:
+    explicit ShardedClockCache(
+        std::vector<Value> free_values,
+        size_t shard_count = DefaultShardCount,
+        ReplacementPolicyType policy_type = ReplacementPolicyType::clock)
+    {
+        shard_count = std::max<size_t>(1, std::min(shard_count, free_values.size()));
+
+        std::vector<std::vector<Value>> shard_values(shard_count);
+        for (size_t i = 0; i < free_values.size(); ++i) {
+            shard_values[i % shard_count].push_back(free_values[i]);
+        }
+
+        for (auto & values : shard_values) {
+            shards.push_back(std::make_unique<Shard>(std::move(values), policy_type));
         }
-        std::vector<Cell> ring;
-        std::unordered_map<Key, int> values;
+    }
+
+    std::pair<bool, Value> find(const Key & key)
+    {
+        auto & shard = getShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        return shard.cache.find(key);
+    }
+
+    Value put(const Key & key)
+    {
+        auto & shard = getShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        return shard.cache.put(key);
+    }
+
+    /// Must be used instead of find + put + lock when several threads can miss on the same key.
+    std::pair<bool, Value> findOrPutLocked(const Key & key)
+    {
+        auto & shard = getShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        return shard.cache.findOrPutLocked(key);
+    }
+
+    void lock(const Key & key)
+    {
+        auto & shard = getShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        shard.cache.lock(key);
+    }
+
+    void unlock(const Key & key)
+    {
+        auto & shard = getShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        shard.cache.unlock(key);
+    }
+
+    size_t getShardCount() const { return shards.size(); }
+
+    static constexpr size_t DefaultShardCount = 16;
+
+private:
+    struct Shard {
+        Shard(std::vector<Value> values, ReplacementPolicyType policy_type) : cache(std::move(values), policy_type)
+        {
+        }
+        std::mutex mutex;
+        ClockCache<Key, Value> cache;
     };
 
-   MyClock myclock;
-   uint64_t time = 0;
+    Shard & getShard(const Key & key) { return *shards[hash(key) % shards.size()]; }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    Hash hash;
 };
 
-}
\ No newline at end of file
+}
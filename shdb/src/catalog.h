@@ -55,13 +55,15 @@ public:
         auto begin = scan.begin();
         auto end = scan.end();
         std::shared_ptr<Schema> schema(new Schema);
+        Rows rows;
         while (begin != end) {
-            Row row = *begin;
+            begin.readRows(rows);
+        }
+        for (const auto & row : rows) {
             ColumnSchema cs;
             cs.name = std::get<std::string>(row[1]);
             cs.type = static_cast<Type>(std::get<uint64_t>(row[2]));
             cs.length = std::get<uint64_t>(row[3]);
-            ++begin;
             schema->push_back(cs);
         }
 
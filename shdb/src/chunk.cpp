@@ -0,0 +1,233 @@
+#include "chunk.h"
+
+#include <stdexcept>
+
+namespace shdb
+{
+
+namespace
+{
+
+template <class T>
+void filterVector(std::vector<T> & values, const std::vector<uint8_t> & selection)
+{
+    size_t result_size = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (selection[i]) {
+            if (result_size != i) {
+                values[result_size] = std::move(values[i]);
+            }
+            ++result_size;
+        }
+    }
+    values.resize(result_size);
+}
+
+Type getValueType(const Value & value)
+{
+    if (std::holds_alternative<uint64_t>(value)) {
+        return Type::uint64;
+    }
+    if (std::holds_alternative<bool>(value)) {
+        return Type::boolean;
+    }
+    if (std::holds_alternative<std::string>(value)) {
+        return Type::string;
+    }
+    return Type::int64;
+}
+
+}
+
+Column::Column(Type type_) : type(type_)
+{
+    switch (type)
+    {
+        case Type::uint64:
+            data = std::vector<uint64_t>();
+            break;
+        case Type::int64:
+            data = std::vector<int64_t>();
+            break;
+        case Type::boolean:
+            data = std::vector<uint8_t>();
+            break;
+        case Type::varchar:
+        case Type::string:
+            data = std::vector<std::string>();
+            break;
+    }
+}
+
+void Column::reserve(size_t size)
+{
+    std::visit([size](auto & values) { values.reserve(size); }, data);
+    null_map.reserve(size);
+}
+
+void Column::append(const Value & value)
+{
+    bool null = std::holds_alternative<Null>(value);
+    null_map.push_back(null);
+
+    switch (type)
+    {
+        case Type::uint64:
+            getUInt64Data().push_back(null ? 0 : std::get<uint64_t>(value));
+            break;
+        case Type::int64:
+            getInt64Data().push_back(null ? 0 : std::get<int64_t>(value));
+            break;
+        case Type::boolean:
+            getBooleanData().push_back(null ? 0 : std::get<bool>(value));
+            break;
+        case Type::varchar:
+        case Type::string:
+            getStringData().push_back(null ? std::string() : std::get<std::string>(value));
+            break;
+    }
+}
+
+Value Column::getValue(size_t index) const
+{
+    if (isNull(index)) {
+        return Null{};
+    }
+
+    switch (type)
+    {
+        case Type::uint64:
+            return getUInt64Data()[index];
+        case Type::int64:
+            return getInt64Data()[index];
+        case Type::boolean:
+            return static_cast<bool>(getBooleanData()[index]);
+        case Type::varchar:
+        case Type::string:
+            return getStringData()[index];
+    }
+
+    throw std::runtime_error("Unexpected column type");
+}
+
+bool Column::hasNulls() const
+{
+    for (auto null : null_map) {
+        if (null) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Column::filter(const std::vector<uint8_t> & selection)
+{
+    std::visit([&selection](auto & values) { filterVector(values, selection); }, data);
+    filterVector(null_map, selection);
+}
+
+Column Column::cut(size_t offset, size_t length) const
+{
+    Column result(type);
+    std::visit(
+        [&](const auto & values)
+        {
+            using Vector = std::decay_t<decltype(values)>;
+            result.data = Vector(values.begin() + offset, values.begin() + offset + length);
+        },
+        data);
+    result.null_map.assign(null_map.begin() + offset, null_map.begin() + offset + length);
+    return result;
+}
+
+Chunk::Chunk(Columns columns_) : columns(std::move(columns_)), row_count(columns.empty() ? 0 : columns[0].size())
+{
+}
+
+Chunk::Chunk(Columns columns_, size_t row_count_) : columns(std::move(columns_)), row_count(row_count_)
+{
+}
+
+Chunk Chunk::fromRows(const Rows & rows, const Types & types)
+{
+    Columns columns;
+    columns.reserve(types.size());
+    for (size_t column_index = 0; column_index < types.size(); ++column_index) {
+        Column column(types[column_index]);
+        column.reserve(rows.size());
+        for (const auto & row : rows) {
+            column.append(row[column_index]);
+        }
+        columns.push_back(std::move(column));
+    }
+
+    return Chunk(std::move(columns), rows.size());
+}
+
+Row Chunk::getRow(size_t index) const
+{
+    Row row;
+    row.reserve(columns.size());
+    for (const auto & column : columns) {
+        row.push_back(column.getValue(index));
+    }
+    return row;
+}
+
+Rows Chunk::getRows() const
+{
+    Rows rows;
+    appendRowsTo(rows);
+    return rows;
+}
+
+void Chunk::appendRowsTo(Rows & rows) const
+{
+    rows.reserve(rows.size() + row_count);
+    for (size_t i = 0; i < row_count; ++i) {
+        rows.push_back(getRow(i));
+    }
+}
+
+void Chunk::filter(const std::vector<uint8_t> & selection)
+{
+    for (auto & column : columns) {
+        column.filter(selection);
+    }
+
+    size_t result_row_count = 0;
+    for (size_t i = 0; i < row_count; ++i) {
+        result_row_count += selection[i] != 0;
+    }
+    row_count = result_row_count;
+}
+
+Chunk Chunk::cut(size_t offset, size_t length) const
+{
+    Columns result;
+    result.reserve(columns.size());
+    for (const auto & column : columns) {
+        result.push_back(column.cut(offset, length));
+    }
+    return Chunk(std::move(result), length);
+}
+
+Types getChunkTypes(const std::shared_ptr<Schema> & schema, const Rows & rows)
+{
+    Types types;
+    if (schema) {
+        for (const auto & column : *schema) {
+            types.push_back(column.type);
+        }
+        return types;
+    }
+
+    if (!rows.empty()) {
+        for (const auto & value : rows[0]) {
+            types.push_back(getValueType(value));
+        }
+    }
+    return types;
+}
+
+}
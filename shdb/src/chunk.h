@@ -0,0 +1,113 @@
+#pragma once
+
+#include <variant>
+#include <vector>
+
+#include "row.h"
+#include "schema.h"
+
+namespace shdb
+{
+
+/// Number of rows executors put into one chunk.
+static constexpr size_t ChunkSize = 1024;
+
+/** Values of one column stored contiguously by type.
+  * boolean is stored as uint8_t, varchar and string as std::string.
+  * Null values have a non-zero byte in the null map and a default value in the data.
+  */
+class Column
+{
+public:
+    explicit Column(Type type_);
+
+    Type getType() const { return type; }
+
+    size_t size() const { return null_map.size(); }
+
+    void reserve(size_t size);
+
+    void append(const Value & value);
+
+    Value getValue(size_t index) const;
+
+    bool isNull(size_t index) const { return null_map[index] != 0; }
+
+    bool hasNulls() const;
+
+    /// Keep only values with non-zero selection byte.
+    void filter(const std::vector<uint8_t> & selection);
+
+    /// Copy values [offset, offset + length) into a new column.
+    Column cut(size_t offset, size_t length) const;
+
+    std::vector<uint64_t> & getUInt64Data() { return std::get<std::vector<uint64_t>>(data); }
+    const std::vector<uint64_t> & getUInt64Data() const { return std::get<std::vector<uint64_t>>(data); }
+
+    std::vector<int64_t> & getInt64Data() { return std::get<std::vector<int64_t>>(data); }
+    const std::vector<int64_t> & getInt64Data() const { return std::get<std::vector<int64_t>>(data); }
+
+    std::vector<uint8_t> & getBooleanData() { return std::get<std::vector<uint8_t>>(data); }
+    const std::vector<uint8_t> & getBooleanData() const { return std::get<std::vector<uint8_t>>(data); }
+
+    std::vector<std::string> & getStringData() { return std::get<std::vector<std::string>>(data); }
+    const std::vector<std::string> & getStringData() const { return std::get<std::vector<std::string>>(data); }
+
+    std::vector<uint8_t> & getNullMap() { return null_map; }
+    const std::vector<uint8_t> & getNullMap() const { return null_map; }
+
+private:
+    using Data = std::variant<std::vector<uint64_t>, std::vector<int64_t>, std::vector<uint8_t>, std::vector<std::string>>;
+
+    Type type;
+    Data data;
+    std::vector<uint8_t> null_map;
+};
+
+using Columns = std::vector<Column>;
+
+/// Batch of rows stored by columns, unit of work of IExecutor::nextBatch.
+class Chunk
+{
+public:
+    Chunk() = default;
+
+    explicit Chunk(Columns columns_);
+
+    Chunk(Columns columns_, size_t row_count_);
+
+    static Chunk fromRows(const Rows & rows, const Types & types);
+
+    size_t getRowCount() const { return row_count; }
+
+    size_t getColumnCount() const { return columns.size(); }
+
+    bool empty() const { return row_count == 0; }
+
+    const Column & getColumn(size_t index) const { return columns[index]; }
+
+    Column & getColumn(size_t index) { return columns[index]; }
+
+    const Columns & getColumns() const { return columns; }
+
+    Row getRow(size_t index) const;
+
+    Rows getRows() const;
+
+    void appendRowsTo(Rows & rows) const;
+
+    /// Keep only rows with non-zero selection byte.
+    void filter(const std::vector<uint8_t> & selection);
+
+    /// Copy rows [offset, offset + length) into a new chunk.
+    Chunk cut(size_t offset, size_t length) const;
+
+private:
+    Columns columns;
+    size_t row_count = 0;
+};
+
+/// Types of schema columns, or types of the first row values if schema is unknown.
+Types getChunkTypes(const std::shared_ptr<Schema> & schema, const Rows & rows);
+
+}
@@ -1,13 +1,138 @@
 #include "executor.h"
+#include "arena.h"
 #include "comparator.h"
+#include "hash_map.h"
+#include "key_encoding.h"
+#include "spill.h"
 #include "unordered_map"
 
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <tuple>
+
 namespace shdb
 {
 
 namespace
 {
 
+/** Sort with up to thread_count threads. The range is split into equal parts that are sorted concurrently,
+  * then neighbour parts are merged pairwise, merges of one round run concurrently too.
+  * Ranges shorter than MinRowsPerThread per thread use fewer threads.
+  */
+template <class Iterator, class Compare>
+void parallelSort(Iterator begin, Iterator end, Compare compare, size_t thread_count)
+{
+    static constexpr size_t MinRowsPerThread = 1 << 14;
+
+    size_t size = end - begin;
+    size_t part_count = std::max<size_t>(1, std::min(thread_count, size / MinRowsPerThread));
+    if (part_count == 1)
+    {
+        std::sort(begin, end, compare);
+        return;
+    }
+
+    std::vector<Iterator> bounds;
+    for (size_t i = 0; i <= part_count; ++i)
+    {
+        bounds.push_back(begin + size * i / part_count);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < part_count; ++i)
+    {
+        threads.emplace_back([&, i] { std::sort(bounds[i], bounds[i + 1], compare); });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t step = 1; step < part_count; step *= 2)
+    {
+        threads.clear();
+        for (size_t i = 0; i + step < part_count; i += 2 * step)
+        {
+            auto middle = bounds[i + step];
+            auto last = bounds[std::min(i + 2 * step, part_count)];
+            threads.emplace_back([&, i, middle, last] { std::inplace_merge(bounds[i], middle, last, compare); });
+        }
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+/// Batch of up to ChunkSize rows of already materialized result, starting at pos.
+std::optional<Chunk> nextRowsBatch(const Rows & rows, size_t & pos, const std::shared_ptr<Schema> & schema)
+{
+    if (pos == rows.size())
+    {
+        return std::nullopt;
+    }
+
+    size_t batch_size = std::min(ChunkSize, rows.size() - pos);
+    Rows batch(rows.begin() + pos, rows.begin() + pos + batch_size);
+    pos += batch_size;
+    return Chunk::fromRows(batch, getChunkTypes(schema, batch));
+}
+
+bool readBatch(IExecutor & executor, Rows & rows)
+{
+    auto chunk = executor.nextBatch();
+    if (!chunk)
+    {
+        return false;
+    }
+    chunk->appendRowsTo(rows);
+    return true;
+}
+
+/// Same as readBatch, also adds the size of the read rows to bytes.
+bool readBatch(IExecutor & executor, Rows & rows, size_t & bytes)
+{
+    size_t old_size = rows.size();
+    if (!readBatch(executor, rows))
+    {
+        return false;
+    }
+    for (size_t i = old_size; i < rows.size(); ++i)
+    {
+        bytes += estimateRowSize(rows[i]);
+    }
+    return true;
+}
+
+/// Row by row access to an executor that reads it chunk by chunk. Rows put in advance are returned first.
+struct BufferedInput
+{
+    ExecutorPtr executor;
+    Rows rows;
+    size_t pos = 0;
+
+    /// Current row without consuming it, nullptr when input is exhausted.
+    const Row * peek()
+    {
+        while (pos == rows.size())
+        {
+            rows.clear();
+            pos = 0;
+            if (!executor || !readBatch(*executor, rows))
+            {
+                executor.reset();
+                return nullptr;
+            }
+        }
+        return &rows[pos];
+    }
+
+    Row pop() { return std::move(rows[pos++]); }
+};
+
 class ReadFromRowsExecutor : public IExecutor
 {
 public:
@@ -38,24 +163,47 @@ private:
 class ReadFromTableExecutor : public IExecutor
 {
 public:
-    explicit ReadFromTableExecutor(std::shared_ptr<ITable> table_, std::shared_ptr<Schema> table_schema_)
+    ReadFromTableExecutor(std::shared_ptr<ITable> table_, std::shared_ptr<Schema> table_schema_, const Scan & scan)
         : table(std::move(table_)), table_schema(std::move(table_schema_))
     {
-        auto scan = Scan(table);
         iterator = std::make_shared<ScanIterator>(scan.begin());
         end = std::make_shared<ScanIterator>(scan.end());
+        types = getChunkTypes(table_schema, {});
     }
 
     std::optional<Row> next() override 
     {
-        if (*iterator == *end)
+        while (pos == rows.size())
+        {
+            if (*iterator == *end)
+            {
+                return std::nullopt;
+            }
+
+            rows.clear();
+            pos = 0;
+            iterator->readRows(rows);
+        }
+
+        return std::move(rows[pos++]);
+    }
+
+    std::optional<Chunk> nextBatch() override
+    {
+        Rows batch(std::make_move_iterator(rows.begin() + pos), std::make_move_iterator(rows.end()));
+        rows.clear();
+        pos = 0;
+
+        while (batch.size() < ChunkSize && *iterator != *end)
+        {
+            iterator->readRows(batch, ChunkSize - batch.size());
+        }
+
+        if (batch.empty())
         {
             return std::nullopt;
         }
-    
-        Row row = iterator->getRow();
-        ++(*iterator);
-        return row;
+        return Chunk::fromRows(batch, types);
     }
 
     std::shared_ptr<Schema> getOutputSchema() override 
@@ -68,6 +216,43 @@ private:
     std::shared_ptr<ScanIterator> iterator;
     std::shared_ptr<ScanIterator> end;
     std::shared_ptr<Schema> table_schema;
+    Types types;
+    /// Live rows of the current page.
+    Rows rows;
+    size_t pos = 0;
+};
+
+/// Rows of table in the order of index keys, rows deleted from the table are skipped.
+class ReadFromIndexExecutor : public IExecutor
+{
+public:
+    explicit ReadFromIndexExecutor(std::shared_ptr<IIndex> index_, std::shared_ptr<ITable> table_, std::shared_ptr<Schema> table_schema_)
+        : index(std::move(index_)), table(std::move(table_)), table_schema(std::move(table_schema_)), iterator(index->read())
+    {}
+
+    std::optional<Row> next() override
+    {
+        while (auto entry = iterator->nextRow())
+        {
+            Row row = table->getRow(entry->second);
+            if (!row.empty())
+            {
+                return row;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::shared_ptr<Schema> getOutputSchema() override
+    {
+        return table_schema;
+    }
+
+private:
+    std::shared_ptr<IIndex> index;
+    std::shared_ptr<ITable> table;
+    std::shared_ptr<Schema> table_schema;
+    std::unique_ptr<IIndexIterator> iterator;
 };
 
 class ExpressionsExecutor : public IExecutor
@@ -92,6 +277,22 @@ public:
         return result;
     }
 
+    std::optional<Chunk> nextBatch() override
+    {
+        auto chunk = input_executor->nextBatch();
+        if (!chunk)
+        {
+            return std::nullopt;
+        }
+
+        Columns columns;
+        for (const auto & expression : expressions)
+        {
+            columns.push_back(expression->evaluateBatch(*chunk));
+        }
+        return Chunk(std::move(columns), chunk->getRowCount());
+    }
+
     std::shared_ptr<Schema> getOutputSchema() override 
     {
         Schema output_schema = Schema();
@@ -133,6 +334,27 @@ public:
         return row;
     }
 
+    std::optional<Chunk> nextBatch() override
+    {
+        while (true)
+        {
+            auto chunk = input_executor->nextBatch();
+            if (!chunk)
+            {
+                return std::nullopt;
+            }
+
+            Column filter_column = filter_expression->evaluateBatch(*chunk);
+            std::vector<uint8_t> & selection = filter_column.getBooleanData();
+            chunk->filter(selection);
+
+            if (!chunk->empty())
+            {
+                return chunk;
+            }
+        }
+    }
+
     std::shared_ptr<Schema> getOutputSchema() override 
     {
         return input_executor->getOutputSchema();
@@ -143,39 +365,59 @@ private:
     ExpressionPtr filter_expression;
 };
 
+/** Sort by expressions. Sort expressions are evaluated once per row, over whole chunks, into a normalized key,
+  * so comparisons during the sort are plain byte string comparisons. Row indexes are sorted by up to max_threads
+  * threads, then rows are permuted.
+  * Without a memory budget the whole input is sorted in memory.
+  * With a budget, every time the buffered input rows and keys take more than max_bytes they are sorted and written
+  * to a temporary table as a sorted run. Runs are then merged lazily by next() with a heap
+  * that holds the current row of every run together with its key.
+  */
 class SortExecutor : public IExecutor
 {
 public:
-    explicit SortExecutor(ExecutorPtr input_executor_, SortExpressions sort_expressions_)
-        : sort_expressions(std::move(sort_expressions_))
+    explicit SortExecutor(
+        ExecutorPtr input_executor_,
+        SortExpressions sort_expressions_,
+        std::shared_ptr<Database> db_ = nullptr,
+        size_t max_bytes_ = 0,
+        size_t max_threads_ = 1)
+        : sort_expressions(std::move(sort_expressions_)), db(std::move(db_)), max_bytes(max_bytes_), max_threads(max_threads_)
     {
-        auto compare = [sort_expressions = sort_expressions](const Row & row1, const Row row2) -> bool
+        schema = input_executor_->getOutputSchema();
+
+        size_t bytes = 0;
+        while (auto chunk = input_executor_->nextBatch())
         {
-            for (auto expr : sort_expressions)
+            size_t old_size = rows.size();
+            appendSortKeys(*chunk);
+            chunk->appendRowsTo(rows);
+            for (size_t i = old_size; i < rows.size(); ++i)
             {
-                bool reverse = expr.desc;
-                auto val1 = expr.expression->evaluate(row1);
-                auto val2 =  expr.expression->evaluate(row2);
-                if (compareValue(val1, val2) == -1)
-                {
-                    return true ^ reverse;
-                }
-                if (compareValue(val1, val2) == 1)
-                {
-                    return false ^ reverse;
-                }
+                bytes += estimateRowSize(rows[i]) + sort_keys[i].size();
             }
-            return false;
-        };
 
-        RowSet row_set = shdb::execute(std::move(input_executor_));
+            if (db && max_bytes != 0 && bytes > max_bytes)
+            {
+                writeRun();
+                bytes = 0;
+            }
+        }
 
-        rows = row_set.getRows();
-        std::sort(rows.begin(), rows.end(), compare);
+        sortRows();
+        if (!runs.empty())
+        {
+            startMerge();
+        }
     }
 
     std::optional<Row> next() override 
     {
+        if (!runs.empty())
+        {
+            return nextMerged();
+        }
+
         if (pos == rows.size())
         {
             return std::nullopt;
@@ -184,197 +426,1566 @@ public:
         return rows[pos++];
     }
 
-    std::shared_ptr<Schema> getOutputSchema() override { throw std::runtime_error("getOutputSchema cannot be called"); }
+    std::optional<Chunk> nextBatch() override
+    {
+        if (!runs.empty())
+        {
+            return IExecutor::nextBatch();
+        }
+        return nextRowsBatch(rows, pos, schema);
+    }
+
+    std::shared_ptr<Schema> getOutputSchema() override { return schema; }
 
 private:
-    SortExpressions sort_expressions;
-    Rows rows;
-    size_t pos = 0;
-};
-
-class JoinExecutor : public IExecutor
-{
-public:
-    explicit JoinExecutor(ExecutorPtr left_input_executor_, ExecutorPtr right_input_executor_)
-        : left_input_executor(std::move(left_input_executor_)), right_input_executor(std::move(right_input_executor_))
+    struct HeapEntry
     {
+        std::string sort_key;
+        size_t input_index;
+    };
 
-        auto left_output_schema = left_input_executor->getOutputSchema();
-        auto right_output_schema = right_input_executor->getOutputSchema();
-        schema = std::make_shared<Schema>(*left_output_schema);
-
-        for (size_t i = 0; i < right_output_schema->size(); i++)
+    void appendSortKeys(const Chunk & chunk)
+    {
+        size_t old_size = sort_keys.size();
+        sort_keys.resize(old_size + chunk.getRowCount());
+        for (const auto & expr : sort_expressions)
         {
-            bool in = false;
-            for (size_t j = 0; j < schema->size(); j++)
-            {
-                if (schema->at(j).name == right_output_schema->at(i).name)
-                {
-                    in = true;
-                    break;
-                }
-            }
-            if (!in)
+            std::optional<Column> holder;
+            const auto & column = evaluateBatch(*expr.expression, chunk, holder);
+            for (size_t i = 0; i < chunk.getRowCount(); ++i)
             {
-                schema->push_back(right_output_schema->at(i));
+                appendNormalizedValue(sort_keys[old_size + i], column.getValue(i), expr.desc);
             }
         }
+    }
 
-        if (schema->size() == left_output_schema->size() + right_output_schema->size())
+    std::string getSortKey(const Row & row) const
+    {
+        std::string key;
+        for (const auto & expr : sort_expressions)
         {
-            return;
+            appendNormalizedValue(key, expr.expression->evaluate(row), expr.desc);
         }
+        return key;
+    }
+
+    void sortRows()
+    {
+        std::vector<size_t> order(rows.size());
+        std::iota(order.begin(), order.end(), 0);
+        parallelSort(
+            order.begin(), order.end(), [this](size_t lhs, size_t rhs) { return sort_keys[lhs] < sort_keys[rhs]; }, max_threads);
 
-        std::unordered_map<size_t, size_t> matching_schema_left;
-        std::unordered_map<size_t, size_t> matching_schema_right;
-        for (size_t i = 0; i < left_output_schema->size(); i++)
+        Rows sorted_rows;
+        sorted_rows.reserve(rows.size());
+        for (auto index : order)
         {
-            for (size_t j = 0; j < right_output_schema->size(); j++)
-            {
-                if (left_output_schema->at(i).name == right_output_schema->at(j).name)
-                {
-                    matching_schema_left[i] = j;
-                    matching_schema_right[j] = i;
-                    break;
-                }
-            }
+            sorted_rows.push_back(std::move(rows[index]));
         }
-        RowSet left_rows = shdb::execute(std::move(left_input_executor));
-        RowSet right_rows = shdb::execute(std::move(right_input_executor));
+        rows = std::move(sorted_rows);
+        sort_keys.clear();
+    }
 
-        for (auto left_row : left_rows.getRows())
+    void writeRun()
+    {
+        sortRows();
+        auto run = std::make_unique<TemporaryTable>(db, schema);
+        for (const auto & row : rows)
         {
-            for (auto right_row : right_rows.getRows())
-            {
-                bool similar = true;
-                for (auto [left_pos, right_pos] : matching_schema_left)
-                {
-                    if (compareValue(left_row[left_pos], right_row[right_pos]) != 0)
-                    {
-                        similar = false;
-                        break;
-                    }
-                }
-                if (similar)
-                {
-                    Row new_row = left_row;
-                    for (size_t i = 0; i < right_row.size(); i++)
-                    {
-                        if (!matching_schema_right.contains(i))
-                        {
-                            new_row.push_back(right_row[i]);
-                        }
-                    }
-                    rows.push_back(std::move(new_row));
-                }
-            }
+            run->insertRow(row);
         }
+        rows.clear();
+        runs.push_back(std::move(run));
     }
 
-    std::optional<Row> next() override 
+    void startMerge()
     {
-        if (pos == rows.size())
+        /// The last run is still in memory and is merged without a round trip to disk.
+        inputs.resize(runs.size() + 1);
+        for (size_t i = 0; i < runs.size(); ++i)
         {
-            return std::nullopt;
+            inputs[i].executor = createReadFromTableExecutor(runs[i]->getTable(), runs[i]->getSchema());
         }
+        inputs.back().rows = std::move(rows);
+        rows.clear();
 
-        return rows[pos++];
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            pushToHeap(i);
+        }
+    }
 
+    /// std heap functions keep the greatest element on top, so the comparison is reversed.
+    static bool heapCompare(const HeapEntry & lhs, const HeapEntry & rhs) { return rhs.sort_key < lhs.sort_key; }
+
+    void pushToHeap(size_t input_index)
+    {
+        const Row * row = inputs[input_index].peek();
+        if (!row)
+        {
+            return;
+        }
+        heap.push_back({getSortKey(*row), input_index});
+        std::push_heap(heap.begin(), heap.end(), heapCompare);
     }
 
-    std::shared_ptr<Schema> getOutputSchema() override 
-    { 
-        return schema;
+    std::optional<Row> nextMerged()
+    {
+        if (heap.empty())
+        {
+            return std::nullopt;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), heapCompare);
+        size_t input_index = heap.back().input_index;
+        heap.pop_back();
+
+        Row row = inputs[input_index].pop();
+        pushToHeap(input_index);
+        return row;
     }
 
-private:
-    ExecutorPtr left_input_executor;
-    ExecutorPtr right_input_executor;
+    SortExpressions sort_expressions;
+    std::shared_ptr<Database> db;
+    size_t max_bytes;
+    size_t max_threads;
     std::shared_ptr<Schema> schema;
     Rows rows;
+    /// Normalized sort keys of rows, only until rows are sorted.
+    std::vector<std::string> sort_keys;
     size_t pos = 0;
+
+    std::vector<TemporaryTablePtr> runs;
+    std::vector<BufferedInput> inputs;
+    std::vector<HeapEntry> heap;
 };
 
-class GroupByExecutor : public IExecutor
+/// Rows, followed by the rest of input.
+class PrependRowsExecutor : public IExecutor
 {
 public:
-    explicit GroupByExecutor(ExecutorPtr input_executor_, GroupByKeys group_by_keys_, GroupByExpressions group_by_expressions_)
-        : input_executor(std::move(input_executor_))
-        , group_by_keys(std::move(group_by_keys_))
-        , group_by_expressions(std::move(group_by_expressions_))
-    {
-        std::unordered_map<Row, std::unordered_map<std::string, AggregateDataPtr>> values;
-        RowSet row_set = shdb::execute(std::move(input_executor));
+    PrependRowsExecutor(Rows rows_, ExecutorPtr input_executor_) : rows(std::move(rows_)), input_executor(std::move(input_executor_)) { }
 
-        for (auto & row : row_set.getRows())
-        {
-            Row val_key;
-            for (auto & key : group_by_keys)
-            {
-                auto value = key.expression->evaluate(row);
-                val_key.push_back(value);
-            }
-            if (!values.contains(val_key)) {
-                values[val_key];
-            }
-            for (auto & expression : group_by_expressions)
-            {
-                Row value = {expression.arguments[0]->evaluate(row)};
-                if (!values[val_key].contains(expression.aggregate_function_column_name))
-                {
-                    auto size = expression.aggregate_function->getStateSize();
-                    values[val_key][expression.aggregate_function_column_name] = std::shared_ptr<char[]>(new char[size]);
-                    expression.aggregate_function->create(values[val_key][expression.aggregate_function_column_name]);
-                }
-                expression.aggregate_function->add(values[val_key][expression.aggregate_function_column_name], value);
-            }
-        }
-        for (auto key : values)
+    std::optional<Row> next() override
+    {
+        if (pos < rows.size())
         {
-            Row new_row = key.first;
-            for (auto & expression : group_by_expressions)
-            {
-                auto result = expression.aggregate_function->getResult(values[key.first][expression.aggregate_function_column_name]);
-                new_row.push_back(result);
-            }
-            rows.push_back(std::move(new_row));
+            return std::move(rows[pos++]);
         }
+        return input_executor->next();
+    }
 
-        schema = std::make_shared<Schema>(Schema());
-        for (auto & key : group_by_keys)
+    std::optional<Chunk> nextBatch() override
+    {
+        if (pos < rows.size())
         {
-            schema->push_back({key.expression_column_name, key.expression->getResultType()});
+            return nextRowsBatch(rows, pos, getOutputSchema());
         }
+        return input_executor->nextBatch();
+    }
 
-        for (auto & expression : group_by_expressions)
-        {
-            schema->push_back({expression.aggregate_function_column_name, expression.arguments[0]->getResultType()});
-        }
+    std::shared_ptr<Schema> getOutputSchema() override { return input_executor->getOutputSchema(); }
+
+private:
+    Rows rows;
+    size_t pos = 0;
+    ExecutorPtr input_executor;
+};
+
+/** ORDER BY with LIMIT: only the first limit rows in sort order are kept, in a bounded max-heap by normalized sort key,
+  * so memory is O(limit) and every input row costs O(log limit) instead of a full sort.
+  * Input is read on the first pull. Once the heap takes more than max_bytes, its rows and the rest of input
+  * are sorted by SortExecutor under the same budget instead, and its first limit rows are returned.
+  */
+class TopNExecutor : public IExecutor
+{
+public:
+    explicit TopNExecutor(
+        ExecutorPtr input_executor_,
+        SortExpressions sort_expressions_,
+        size_t limit_,
+        std::shared_ptr<Database> db_ = nullptr,
+        size_t max_bytes_ = 0,
+        size_t max_threads_ = 1)
+        : input_executor(std::move(input_executor_))
+        , sort_expressions(std::move(sort_expressions_))
+        , limit(limit_)
+        , db(std::move(db_))
+        , max_bytes(max_bytes_)
+        , max_threads(max_threads_)
+    {
+        schema = input_executor->getOutputSchema();
     }
 
-    std::optional<Row> next() override 
+    std::optional<Row> next() override
     {
+        build();
+        if (sort_executor)
+        {
+            if (pos == limit)
+            {
+                return std::nullopt;
+            }
+            auto row = sort_executor->next();
+            pos += row.has_value();
+            return row;
+        }
+
         if (pos == rows.size())
         {
             return std::nullopt;
         }
+
         return rows[pos++];
     }
 
-    std::shared_ptr<Schema> getOutputSchema() override 
+    std::optional<Chunk> nextBatch() override
     {
-       return schema;
+        build();
+        if (sort_executor)
+        {
+            return IExecutor::nextBatch();
+        }
+        return nextRowsBatch(rows, pos, schema);
     }
 
-private:
-    ExecutorPtr input_executor;
-    GroupByKeys group_by_keys;
-    GroupByExpressions group_by_expressions;
-    Rows rows;
-    size_t pos = 0;
-    std::shared_ptr<Schema> schema;
-};
+    std::shared_ptr<Schema> getOutputSchema() override { return schema; }
 
+private:
+    struct HeapEntry
+    {
+        std::string sort_key;
+        Row row;
+    };
+
+    /// Greatest key on top, it is the first one to be replaced.
+    static bool heapCompare(const HeapEntry & lhs, const HeapEntry & rhs) { return lhs.sort_key < rhs.sort_key; }
+
+    static size_t estimateEntrySize(const HeapEntry & entry) { return estimateRowSize(entry.row) + entry.sort_key.size(); }
+
+    void build()
+    {
+        if (!input_executor)
+        {
+            return;
+        }
+        auto input = std::move(input_executor);
+        if (limit == 0)
+        {
+            return;
+        }
+
+        std::vector<HeapEntry> heap;
+        size_t heap_bytes = 0;
+        std::vector<std::string> keys;
+        while (auto chunk = input->nextBatch())
+        {
+            keys.assign(chunk->getRowCount(), std::string());
+            for (const auto & expr : sort_expressions)
+            {
+                std::optional<Column> holder;
+                const auto & column = evaluateBatch(*expr.expression, *chunk, holder);
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    appendNormalizedValue(keys[i], column.getValue(i), expr.desc);
+                }
+            }
+
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (heap.size() == limit && !(keys[i] < heap.front().sort_key))
+                {
+                    continue;
+                }
+                if (heap.size() == limit)
+                {
+                    std::pop_heap(heap.begin(), heap.end(), heapCompare);
+                    heap_bytes -= estimateEntrySize(heap.back());
+                    heap.pop_back();
+                }
+                heap.push_back({std::move(keys[i]), chunk->getRow(i)});
+                heap_bytes += estimateEntrySize(heap.back());
+                std::push_heap(heap.begin(), heap.end(), heapCompare);
+
+                if (db && max_bytes != 0 && heap_bytes > max_bytes)
+                {
+                    Rows pending;
+                    pending.reserve(heap.size() + keys.size() - i - 1);
+                    for (auto & entry : heap)
+                    {
+                        pending.push_back(std::move(entry.row));
+                    }
+                    for (size_t j = i + 1; j < keys.size(); ++j)
+                    {
+                        pending.push_back(chunk->getRow(j));
+                    }
+                    sort_executor = std::make_unique<SortExecutor>(
+                        std::make_unique<PrependRowsExecutor>(std::move(pending), std::move(input)), sort_expressions, db, max_bytes, max_threads);
+                    return;
+                }
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end(), heapCompare);
+        rows.reserve(heap.size());
+        for (auto & entry : heap)
+        {
+            rows.push_back(std::move(entry.row));
+        }
+    }
+
+    /// Not null until input is read.
+    ExecutorPtr input_executor;
+    SortExpressions sort_expressions;
+    size_t limit;
+    std::shared_ptr<Database> db;
+    size_t max_bytes;
+    size_t max_threads;
+    std::shared_ptr<Schema> schema;
+    /// Set if the heap didn't fit into max_bytes.
+    std::unique_ptr<SortExecutor> sort_executor;
+    Rows rows;
+    /// Position in rows, or number of rows returned by sort_executor.
+    size_t pos = 0;
+};
+
+/** Skips the first offset rows and returns at most limit rows after them.
+  * Input is not read any further once the limit is reached, so a lazy pipeline below stops early.
+  */
+class LimitExecutor : public IExecutor
+{
+public:
+    explicit LimitExecutor(ExecutorPtr input_executor_, size_t limit_, size_t offset_)
+        : input_executor(std::move(input_executor_)), limit(limit_), offset(offset_)
+    {}
+
+    std::optional<Row> next() override
+    {
+        if (limit == 0)
+        {
+            return std::nullopt;
+        }
+
+        while (offset > 0)
+        {
+            if (!input_executor->next())
+            {
+                return std::nullopt;
+            }
+            offset -= 1;
+        }
+
+        if (limit == 0)
+        {
+            return std::nullopt;
+        }
+
+        auto row = input_executor->next();
+        if (row)
+        {
+            limit -= 1;
+        }
+        return row;
+    }
+
+    std::optional<Chunk> nextBatch() override
+    {
+        while (limit > 0)
+        {
+            auto chunk = input_executor->nextBatch();
+            if (!chunk)
+            {
+                return std::nullopt;
+            }
+
+            size_t row_count = chunk->getRowCount();
+            if (offset >= row_count)
+            {
+                offset -= row_count;
+                continue;
+            }
+
+            size_t length = std::min(limit, row_count - offset);
+            if (offset != 0 || length != row_count)
+            {
+                *chunk = chunk->cut(offset, length);
+            }
+            offset = 0;
+            limit -= length;
+            return chunk;
+        }
+
+        return std::nullopt;
+    }
+
+    std::shared_ptr<Schema> getOutputSchema() override { return input_executor->getOutputSchema(); }
+
+private:
+    ExecutorPtr input_executor;
+    size_t limit;
+    size_t offset;
+};
+
+/** Columns of a natural join: common columns of both inputs ordered as in the left input,
+  * and the other right input columns that are appended to left rows. Returns the output schema.
+  */
+std::shared_ptr<Schema> getNaturalJoinColumns(
+    const Schema & left_schema,
+    const Schema & right_schema,
+    std::vector<size_t> & left_key_positions,
+    std::vector<size_t> & right_key_positions,
+    std::vector<size_t> & right_value_positions)
+{
+    auto schema = std::make_shared<Schema>(left_schema);
+    for (size_t i = 0; i < left_schema.size(); i++)
+    {
+        for (size_t j = 0; j < right_schema.size(); j++)
+        {
+            if (left_schema[i].name == right_schema[j].name)
+            {
+                left_key_positions.push_back(i);
+                right_key_positions.push_back(j);
+                break;
+            }
+        }
+    }
+
+    for (size_t j = 0; j < right_schema.size(); j++)
+    {
+        if (std::find(right_key_positions.begin(), right_key_positions.end(), j) == right_key_positions.end())
+        {
+            right_value_positions.push_back(j);
+            schema->push_back(right_schema[j]);
+        }
+    }
+    return schema;
+}
+
+Row getKey(const Row & row, const std::vector<size_t> & key_positions)
+{
+    Row key;
+    key.reserve(key_positions.size());
+    for (auto position : key_positions)
+    {
+        key.push_back(row[position]);
+    }
+    return key;
+}
+
+/// Left row followed by the non-key columns of right row.
+Row joinRows(const Row & left_row, const Row & right_row, const std::vector<size_t> & right_value_positions)
+{
+    Row row = left_row;
+    row.reserve(row.size() + right_value_positions.size());
+    for (auto position : right_value_positions)
+    {
+        row.push_back(right_row[position]);
+    }
+    return row;
+}
+
+/** Natural hash join.
+  * Inputs are read chunk by chunk, always from the side with fewer bytes read so far, until one of them is exhausted.
+  * That smaller side becomes the build side
+  * and is put into a hash table keyed by the common columns. The other side is probed row by row as it streams,
+  * only its prefix read while looking for the smaller side is kept in memory.
+  *
+  * With a memory budget, once each input has more than max_bytes / 2 bytes of rows read, both inputs are partitioned
+  * by key hash into temporary tables (Grace hash join). Matching rows always land in partitions with the same number,
+  * so every pair of partitions is joined on its own by a nested JoinExecutor, which partitions again
+  * with the next level hash if the pair still does not fit. Below MaxSpillLevel keys are assumed to be too skewed
+  * to split and the last level joins in memory. A cross join has no key to partition by, so under the budget
+  * it writes the right input to a temporary table and scans it once for every block of left rows
+  * that fits into max_bytes / 2 (block nested-loop join).
+  */
+class JoinExecutor : public IExecutor
+{
+public:
+    explicit JoinExecutor(
+        ExecutorPtr left_input_executor_,
+        ExecutorPtr right_input_executor_,
+        std::shared_ptr<Database> db_ = nullptr,
+        size_t max_bytes_ = 0,
+        size_t level_ = 0)
+        : left_input_executor(std::move(left_input_executor_))
+        , right_input_executor(std::move(right_input_executor_))
+        , db(std::move(db_))
+        , max_bytes(max_bytes_)
+        , level(level_)
+    {
+        left_output_schema = left_input_executor->getOutputSchema();
+        right_output_schema = right_input_executor->getOutputSchema();
+        schema = getNaturalJoinColumns(*left_output_schema, *right_output_schema, left_key_positions, right_key_positions, right_value_positions);
+
+        build();
+    }
+
+    std::optional<Row> next() override 
+    {
+        if (spilled)
+        {
+            return nextFromPartitions();
+        }
+
+        if (right_table)
+        {
+            return nextFromBlocks();
+        }
+
+        while (true)
+        {
+            if (current_matches && match_pos < current_matches->size())
+            {
+                const Row & build_row = (*current_matches)[match_pos++];
+                return build_left ? joinRows(build_row, probe_row, right_value_positions) : joinRows(probe_row, build_row, right_value_positions);
+            }
+
+            auto row = nextProbeRow();
+            if (!row)
+            {
+                return std::nullopt;
+            }
+
+            auto it = hash_table.find(getKey(*row, build_left ? right_key_positions : left_key_positions));
+            if (it == hash_table.end())
+            {
+                current_matches = nullptr;
+                continue;
+            }
+
+            probe_row = std::move(*row);
+            current_matches = &it->second;
+            match_pos = 0;
+        }
+    }
+
+    std::shared_ptr<Schema> getOutputSchema() override 
+    { 
+        return schema;
+    }
+
+private:
+    static constexpr size_t PartitionCount = 16;
+    static constexpr size_t MaxSpillLevel = 4;
+
+    using Partitions = std::vector<TemporaryTablePtr>;
+
+
+    bool canSpill() const
+    {
+        return db && max_bytes != 0 && (level < MaxSpillLevel || left_key_positions.empty());
+    }
+
+    void build()
+    {
+        Rows left_rows;
+        Rows right_rows;
+        size_t left_bytes = 0;
+        size_t right_bytes = 0;
+        while (true)
+        {
+            bool read_left = left_bytes <= right_bytes;
+            bool has_more = read_left
+                ? readBatch(*left_input_executor, left_rows, left_bytes)
+                : readBatch(*right_input_executor, right_rows, right_bytes);
+            if (!has_more)
+            {
+                build_left = read_left;
+                break;
+            }
+            /// Reads always go to the smaller side, so until it exceeds half of the budget
+            /// the other side is at most one chunk bigger and both still fit.
+            if (canSpill() && std::min(left_bytes, right_bytes) > max_bytes / 2)
+            {
+                if (left_key_positions.empty())
+                {
+                    spillCrossJoin(std::move(left_rows), std::move(right_rows));
+                }
+                else
+                {
+                    spill(std::move(left_rows), std::move(right_rows));
+                }
+                return;
+            }
+        }
+
+        Rows & build_rows = build_left ? left_rows : right_rows;
+        const auto & build_key_positions = build_left ? left_key_positions : right_key_positions;
+        for (auto & row : build_rows)
+        {
+            auto key = getKey(row, build_key_positions);
+            hash_table[std::move(key)].push_back(std::move(row));
+        }
+
+        probe_rows = std::move(build_left ? right_rows : left_rows);
+        probe_executor = std::move(build_left ? right_input_executor : left_input_executor);
+    }
+
+    Partitions partition(Rows rows, ExecutorPtr executor, const std::shared_ptr<Schema> & input_schema, const std::vector<size_t> & key_positions)
+    {
+        Partitions result;
+        for (size_t i = 0; i < PartitionCount; ++i)
+        {
+            result.push_back(std::make_unique<TemporaryTable>(db, input_schema));
+        }
+
+        do
+        {
+            for (const auto & row : rows)
+            {
+                result[getPartitionHash(getKey(row, key_positions), level) % PartitionCount]->insertRow(row);
+            }
+            rows.clear();
+        }
+        while (readBatch(*executor, rows));
+
+        return result;
+    }
+
+    void spill(Rows left_rows, Rows right_rows)
+    {
+        spilled = true;
+        left_partitions = partition(std::move(left_rows), std::move(left_input_executor), left_output_schema, left_key_positions);
+        right_partitions = partition(std::move(right_rows), std::move(right_input_executor), right_output_schema, right_key_positions);
+    }
+
+    std::optional<Row> nextFromPartitions()
+    {
+        while (true)
+        {
+            if (partition_join)
+            {
+                if (auto row = partition_join->next())
+                {
+                    return row;
+                }
+                partition_join.reset();
+                left_partitions[partition_index - 1].reset();
+                right_partitions[partition_index - 1].reset();
+            }
+
+            if (partition_index == PartitionCount)
+            {
+                return std::nullopt;
+            }
+
+            auto & left_partition = left_partitions[partition_index];
+            auto & right_partition = right_partitions[partition_index];
+            partition_index += 1;
+
+            /// Inner join of a partition with an empty one is empty.
+            if (left_partition->getRowCount() == 0 || right_partition->getRowCount() == 0)
+            {
+                left_partition.reset();
+                right_partition.reset();
+                continue;
+            }
+
+            partition_join = std::make_unique<JoinExecutor>(
+                createReadFromTableExecutor(left_partition->getTable(), left_partition->getSchema()),
+                createReadFromTableExecutor(right_partition->getTable(), right_partition->getSchema()),
+                db,
+                max_bytes,
+                level + 1);
+        }
+    }
+
+    void spillCrossJoin(Rows left_rows, Rows right_rows)
+    {
+        right_table = std::make_unique<TemporaryTable>(db, right_output_schema);
+        do
+        {
+            for (const auto & row : right_rows)
+            {
+                right_table->insertRow(row);
+            }
+            right_rows.clear();
+        }
+        while (readBatch(*right_input_executor, right_rows));
+        right_input_executor.reset();
+
+        /// Left rows read so far are at most one chunk over half of the budget, they are the first block.
+        left_block = std::move(left_rows);
+    }
+
+    bool readLeftBlock()
+    {
+        left_block.clear();
+        size_t bytes = 0;
+        while (left_input_executor && bytes <= max_bytes / 2)
+        {
+            if (!readBatch(*left_input_executor, left_block, bytes))
+            {
+                left_input_executor.reset();
+            }
+        }
+        return !left_block.empty();
+    }
+
+    std::optional<Row> nextFromBlocks()
+    {
+        while (!left_block.empty())
+        {
+            if (right_row && block_pos < left_block.size())
+            {
+                return joinRows(left_block[block_pos++], *right_row, right_value_positions);
+            }
+
+            if (right_scan)
+            {
+                right_row = right_scan->next();
+                block_pos = 0;
+                if (right_row)
+                {
+                    continue;
+                }
+                right_scan.reset();
+                if (!readLeftBlock())
+                {
+                    return std::nullopt;
+                }
+            }
+
+            right_scan = createReadFromTableExecutor(right_table->getTable(), right_table->getSchema());
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Row> nextProbeRow()
+    {
+        while (probe_pos == probe_rows.size())
+        {
+            probe_rows.clear();
+            probe_pos = 0;
+            if (!probe_executor || !readBatch(*probe_executor, probe_rows))
+            {
+                probe_executor.reset();
+                return std::nullopt;
+            }
+        }
+
+        return std::move(probe_rows[probe_pos++]);
+    }
+
+    ExecutorPtr left_input_executor;
+    ExecutorPtr right_input_executor;
+    std::shared_ptr<Database> db;
+    size_t max_bytes;
+    size_t level;
+    std::shared_ptr<Schema> left_output_schema;
+    std::shared_ptr<Schema> right_output_schema;
+    std::shared_ptr<Schema> schema;
+    std::vector<size_t> left_key_positions;
+    std::vector<size_t> right_key_positions;
+    std::vector<size_t> right_value_positions;
+
+    bool build_left = false;
+    std::unordered_map<Row, Rows> hash_table;
+
+    ExecutorPtr probe_executor;
+    Rows probe_rows;
+    size_t probe_pos = 0;
+
+    Row probe_row;
+    const Rows * current_matches = nullptr;
+    size_t match_pos = 0;
+
+    bool spilled = false;
+    Partitions left_partitions;
+    Partitions right_partitions;
+    size_t partition_index = 0;
+    ExecutorPtr partition_join;
+
+    TemporaryTablePtr right_table;
+    Rows left_block;
+    size_t block_pos = 0;
+    ExecutorPtr right_scan;
+    std::optional<Row> right_row;
+};
+
+/** Natural merge join of inputs sorted in ascending compareValue order of their common columns,
+  * taken in the order they appear in the left input. Single pass over both inputs,
+  * only the current run of right rows with equal keys is kept in memory.
+  */
+class MergeJoinExecutor : public IExecutor
+{
+public:
+    explicit MergeJoinExecutor(ExecutorPtr left_input_executor, ExecutorPtr right_input_executor)
+    {
+        left.executor = std::move(left_input_executor);
+        right.executor = std::move(right_input_executor);
+        schema = getNaturalJoinColumns(
+            *left.executor->getOutputSchema(),
+            *right.executor->getOutputSchema(),
+            left_key_positions,
+            right_key_positions,
+            right_value_positions);
+    }
+
+    std::optional<Row> next() override
+    {
+        while (true)
+        {
+            if (match_pos < right_run.size())
+            {
+                return joinRows(left_row, right_run[match_pos++], right_value_positions);
+            }
+
+            const Row * left_next = left.peek();
+            if (!left_next)
+            {
+                return std::nullopt;
+            }
+
+            /// Next left row with the key of the current run joins the same right rows.
+            if (!right_run.empty() && compareWithRunKey(*left_next, left_key_positions) == 0)
+            {
+                left_row = left.pop();
+                match_pos = 0;
+                continue;
+            }
+            right_run.clear();
+
+            const Row * right_next = right.peek();
+            if (!right_next)
+            {
+                return std::nullopt;
+            }
+
+            auto compare_result = compareKeys(*left_next, *right_next);
+            if (compare_result < 0)
+            {
+                left.pop();
+            }
+            else if (compare_result > 0)
+            {
+                right.pop();
+            }
+            else
+            {
+                run_key = getKey(*right_next, right_key_positions);
+                do
+                {
+                    right_run.push_back(right.pop());
+                    right_next = right.peek();
+                }
+                while (right_next && compareWithRunKey(*right_next, right_key_positions) == 0);
+
+                left_row = left.pop();
+                match_pos = 0;
+            }
+        }
+    }
+
+    std::shared_ptr<Schema> getOutputSchema() override
+    {
+        return schema;
+    }
+
+private:
+    int16_t compareKeys(const Row & lhs, const Row & rhs) const
+    {
+        for (size_t i = 0; i < left_key_positions.size(); ++i)
+        {
+            auto result = compareValue(lhs[left_key_positions[i]], rhs[right_key_positions[i]]);
+            if (result != 0)
+            {
+                return result;
+            }
+        }
+        return 0;
+    }
+
+    int16_t compareWithRunKey(const Row & row, const std::vector<size_t> & key_positions) const
+    {
+        for (size_t i = 0; i < key_positions.size(); ++i)
+        {
+            auto result = compareValue(row[key_positions[i]], run_key[i]);
+            if (result != 0)
+            {
+                return result;
+            }
+        }
+        return 0;
+    }
+
+    BufferedInput left;
+    BufferedInput right;
+    std::shared_ptr<Schema> schema;
+    std::vector<size_t> left_key_positions;
+    std::vector<size_t> right_key_positions;
+    std::vector<size_t> right_value_positions;
+
+    Row left_row;
+    Row run_key;
+    Rows right_run;
+    size_t match_pos = 0;
+};
+
+/** Index nested-loop join: for every outer row matching inner rows are looked up in an index on the common columns.
+  * Output rows are inner rows followed by the non-key columns of outer rows.
+  * Outer rows are processed a chunk at a time, RowIds found for the whole chunk are sorted by page
+  * before inner rows are fetched, so every inner page is read at most once per chunk.
+  */
+class IndexJoinExecutor : public IExecutor
+{
+public:
+    explicit IndexJoinExecutor(
+        ExecutorPtr outer_input_executor_,
+        std::shared_ptr<IIndex> index_,
+        const Schema & index_key_schema,
+        std::shared_ptr<ITable> inner_table_,
+        const Schema & inner_table_schema)
+        : outer_input_executor(std::move(outer_input_executor_)), index(std::move(index_)), inner_table(std::move(inner_table_))
+    {
+        const auto & outer_schema = *outer_input_executor->getOutputSchema();
+        std::vector<size_t> outer_key_positions;
+        std::vector<size_t> inner_key_positions;
+        /// Inner columns go first, as JoinExecutor puts them when the inner table is its left input,
+        /// so a query returns the same columns whether or not the join uses an index.
+        schema = getNaturalJoinColumns(inner_table_schema, outer_schema, inner_key_positions, outer_key_positions, outer_value_positions);
+
+        for (const auto & key_column : index_key_schema)
+        {
+            for (auto position : outer_key_positions)
+            {
+                if (outer_schema[position].name == key_column.name)
+                {
+                    index_key_positions.push_back(position);
+                    break;
+                }
+            }
+        }
+
+        if (index_key_positions.size() != index_key_schema.size() || index_key_positions.size() != outer_key_positions.size())
+        {
+            throw std::runtime_error("Index key does not match join columns");
+        }
+    }
+
+    std::optional<Row> next() override
+    {
+        while (pos == rows.size())
+        {
+            if (!joinNextBatch())
+            {
+                return std::nullopt;
+            }
+        }
+
+        return std::move(rows[pos++]);
+    }
+
+    std::shared_ptr<Schema> getOutputSchema() override
+    {
+        return schema;
+    }
+
+private:
+    bool joinNextBatch()
+    {
+        rows.clear();
+        pos = 0;
+
+        Rows outer_rows;
+        if (!readBatch(*outer_input_executor, outer_rows))
+        {
+            return false;
+        }
+
+        /// Inner RowId and position of the outer row it matches.
+        std::vector<std::pair<RowId, size_t>> matches;
+        std::vector<RowId> row_ids;
+        for (size_t i = 0; i < outer_rows.size(); ++i)
+        {
+            row_ids.clear();
+            index->lookup(getKey(outer_rows[i], index_key_positions), row_ids);
+            for (const auto & row_id : row_ids)
+            {
+                matches.emplace_back(row_id, i);
+            }
+        }
+
+        std::sort(
+            matches.begin(),
+            matches.end(),
+            [](const auto & lhs, const auto & rhs)
+            {
+                return std::tie(lhs.first.page_index, lhs.first.row_index) < std::tie(rhs.first.page_index, rhs.first.row_index);
+            });
+
+        for (const auto & [row_id, outer_index] : matches)
+        {
+            Row inner_row = inner_table->getRow(row_id);
+            if (!inner_row.empty())
+            {
+                rows.push_back(joinRows(inner_row, outer_rows[outer_index], outer_value_positions));
+            }
+        }
+
+        return true;
+    }
+
+    ExecutorPtr outer_input_executor;
+    std::shared_ptr<IIndex> index;
+    std::shared_ptr<ITable> inner_table;
+    std::shared_ptr<Schema> schema;
+    std::vector<size_t> index_key_positions;
+    std::vector<size_t> outer_value_positions;
+
+    /// Joined rows of the current outer chunk.
+    Rows rows;
+    size_t pos = 0;
+};
+
+/// Group keys as rows of any types, hashed with std::hash<Row>.
+struct RowKeyMethod
+{
+    using Key = Row;
+    using Map = std::unordered_map<Row, AggregateDataPtr>;
+
+    static void packKeys(const std::vector<const Column *> & key_columns, size_t row_count, std::vector<Key> & keys)
+    {
+        keys.assign(row_count, Row());
+        for (const auto * column : key_columns)
+        {
+            for (size_t i = 0; i < row_count; ++i)
+            {
+                keys[i].push_back(column->getValue(i));
+            }
+        }
+    }
+
+    static std::pair<AggregateDataPtr &, bool> emplace(Map & map, const Key & key)
+    {
+        auto [it, inserted] = map.try_emplace(key, nullptr);
+        return {it->second, inserted};
+    }
+
+    static AggregateDataPtr * find(Map & map, const Key & key)
+    {
+        auto it = map.find(key);
+        return it == map.end() ? nullptr : &it->second;
+    }
+
+    /// Key and hash table node of a new group.
+    static size_t getKeyBytes(const Key & key) { return estimateRowSize(key) + 4 * sizeof(void *); }
+
+    template <class Function>
+    static void forEach(Map & map, Function && function)
+    {
+        for (auto & [key, states] : map)
+        {
+            function(key, states);
+        }
+    }
+
+    static Row unpackKey(const Key & key, const Types &) { return key; }
+};
+
+/// Group keys of N int64, uint64 or boolean columns packed into a FixedKey.
+template <size_t N>
+struct FixedKeyMethod
+{
+    using Key = FixedKey<N>;
+    using Map = FixedHashMap<Key, AggregateDataPtr, FixedKeyHash<N>>;
+
+    static void packKeys(const std::vector<const Column *> & key_columns, size_t row_count, std::vector<Key> & keys)
+    {
+        keys.assign(row_count, Key{});
+        for (size_t k = 0; k < N; ++k)
+        {
+            packKeyColumn(*key_columns[k], k, keys);
+        }
+    }
+
+    static std::pair<AggregateDataPtr &, bool> emplace(Map & map, const Key & key) { return map.emplace(key); }
+
+    static AggregateDataPtr * find(Map & map, const Key & key) { return map.find(key); }
+
+    /// The cell of a new group, the table is at least half empty.
+    static size_t getKeyBytes(const Key &) { return 2 * (sizeof(Key) + sizeof(AggregateDataPtr) + sizeof(bool)); }
+
+    template <class Function>
+    static void forEach(Map & map, Function && function)
+    {
+        map.forEach(function);
+    }
+
+    static Row unpackKey(const Key & key, const Types & key_types)
+    {
+        Row row;
+        for (size_t k = 0; k < N; ++k)
+        {
+            if ((key.null_mask >> k) & 1)
+            {
+                row.push_back(Null{});
+                continue;
+            }
+
+            switch (key_types[k])
+            {
+                case Type::int64:
+                    row.push_back(static_cast<int64_t>(key.values[k]));
+                    break;
+                case Type::boolean:
+                    row.push_back(key.values[k] != 0);
+                    break;
+                default:
+                    row.push_back(key.values[k]);
+                    break;
+            }
+        }
+        return row;
+    }
+
+    static void packKeyColumn(const Column & column, size_t k, std::vector<Key> & keys)
+    {
+        switch (column.getType())
+        {
+            case Type::int64:
+            {
+                const auto & data = column.getInt64Data();
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    keys[i].values[k] = static_cast<uint64_t>(data[i]);
+                }
+                break;
+            }
+            case Type::uint64:
+            {
+                const auto & data = column.getUInt64Data();
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    keys[i].values[k] = data[i];
+                }
+                break;
+            }
+            case Type::boolean:
+            {
+                const auto & data = column.getBooleanData();
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    keys[i].values[k] = data[i];
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unexpected fixed key column type");
+        }
+
+        /// Null values are stored as zero, the mask tells them from real zeros.
+        const auto & null_map = column.getNullMap();
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            keys[i].null_mask |= static_cast<uint64_t>(null_map[i] != 0) << k;
+        }
+    }
+};
+
+/** Hash aggregation. States of all aggregate functions of a group are laid out contiguously at offsets
+  * computed once from getStateSize(), and every group takes one allocation from an arena,
+  * so the hash table maps a group key to a single pointer and no per-state heap allocation is made.
+  * Keys and arguments are evaluated over whole chunks.
+  *
+  * The hash table is chosen from the key types: up to MaxFixedKeyColumns int64, uint64 and boolean keys
+  * are packed into a FixedKey in an open addressing FixedHashMap, other keys (strings, many columns)
+  * use an unordered_map keyed by Row.
+  *
+  * Several inputs, e.g. disjoint page ranges of one table, are aggregated by one thread each
+  * into a thread-local hash table and arena. The tables are then merged into the first one,
+  * states of groups seen by several threads are combined with IAggregateFunction::merge.
+  *
+  * With a memory budget, a thread whose groups take more than its share of max_bytes stops creating groups.
+  * Rows of groups it already has are still aggregated in memory, rows with new keys are written
+  * to PartitionCount temporary tables by key hash. Every partition is then aggregated on its own
+  * by a nested GroupByExecutor, which partitions again with the next level hash if it still does not fit.
+  * With several threads a spilled key may have a group in memory created by another thread,
+  * so partitions are first filtered against the merged hash table.
+  */
+class GroupByExecutor : public IExecutor
+{
+public:
+    explicit GroupByExecutor(
+        std::vector<ExecutorPtr> input_executors_,
+        GroupByKeys group_by_keys_,
+        GroupByExpressions group_by_expressions_,
+        std::shared_ptr<Database> db_ = nullptr,
+        size_t max_bytes_ = 0,
+        size_t level_ = 0)
+        : input_executors(std::move(input_executors_))
+        , group_by_keys(std::move(group_by_keys_))
+        , group_by_expressions(std::move(group_by_expressions_))
+        , db(std::move(db_))
+        , max_bytes(max_bytes_)
+        , level(level_)
+    {
+        input_schema = input_executors.front()->getOutputSchema();
+
+        for (auto & expression : group_by_expressions)
+        {
+            state_offsets.push_back(states_size);
+            states_size += alignStateSize(expression.aggregate_function->getStateSize());
+        }
+
+        bool fixed_keys = group_by_keys.size() <= MaxFixedKeyColumns;
+        for (auto & key : group_by_keys)
+        {
+            auto type = key.expression->getResultType();
+            key_types.push_back(type);
+            fixed_keys &= type == Type::int64 || type == Type::uint64 || type == Type::boolean;
+        }
+
+        switch (fixed_keys ? group_by_keys.size() : 0)
+        {
+            case 1:
+                aggregate<FixedKeyMethod<1>>();
+                break;
+            case 2:
+                aggregate<FixedKeyMethod<2>>();
+                break;
+            case 3:
+                aggregate<FixedKeyMethod<3>>();
+                break;
+            case 4:
+                aggregate<FixedKeyMethod<4>>();
+                break;
+            default:
+                aggregate<RowKeyMethod>();
+                break;
+        }
+
+        schema = std::make_shared<Schema>(Schema());
+        for (auto & key : group_by_keys)
+        {
+            schema->push_back({key.expression_column_name, key.expression->getResultType()});
+        }
+
+        for (auto & expression : group_by_expressions)
+        {
+            schema->push_back({expression.aggregate_function_column_name, expression.aggregate_function->getResultType()});
+        }
+    }
+
+    std::optional<Row> next() override 
+    {
+        if (pos == rows.size())
+        {
+            return std::nullopt;
+        }
+        return rows[pos++];
+    }
+
+    std::optional<Chunk> nextBatch() override { return nextRowsBatch(rows, pos, schema); }
+
+    std::shared_ptr<Schema> getOutputSchema() override 
+    {
+       return schema;
+    }
+
+private:
+    static constexpr size_t MaxFixedKeyColumns = 4;
+    static constexpr size_t PartitionCount = 16;
+    static constexpr size_t MaxSpillLevel = 4;
+
+    /// Without keys there is a single group, which always fits.
+    bool canSpill() const
+    {
+        return db && max_bytes != 0 && level < MaxSpillLevel && !group_by_keys.empty();
+    }
+
+    template <class Method>
+    void aggregate()
+    {
+        size_t input_count = input_executors.size();
+        std::vector<typename Method::Map> maps(input_count);
+        /// States live only until results are taken, merged states stay in the arena of the thread that created them.
+        std::vector<Arena> arenas(input_count);
+
+        if (input_count == 1)
+        {
+            aggregateInput<Method>(*input_executors[0], maps[0], arenas[0]);
+        }
+        else
+        {
+            std::vector<std::exception_ptr> exceptions(input_count);
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < input_count; ++i)
+            {
+                threads.emplace_back(
+                    [&, i]
+                    {
+                        try
+                        {
+                            aggregateInput<Method>(*input_executors[i], maps[i], arenas[i]);
+                        }
+                        catch (...)
+                        {
+                            exceptions[i] = std::current_exception();
+                        }
+                    });
+            }
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+            for (auto & exception : exceptions)
+            {
+                if (exception)
+                {
+                    std::rethrow_exception(exception);
+                }
+            }
+        }
+
+        auto & result_map = maps[0];
+        for (size_t i = 1; i < input_count; ++i)
+        {
+            Method::forEach(
+                maps[i],
+                [&](const typename Method::Key & key, AggregateDataPtr states)
+                {
+                    auto [result_states, inserted] = Method::emplace(result_map, key);
+                    if (inserted)
+                    {
+                        result_states = states;
+                        return;
+                    }
+                    mergeStates(result_states, states);
+                    destroyStates(states);
+                });
+        }
+
+        for (auto & partition : partitions)
+        {
+            aggregatePartition<Method>(std::move(partition), result_map);
+        }
+        partitions.clear();
+
+        Method::forEach(
+            result_map,
+            [&](const typename Method::Key & key, AggregateDataPtr states) { appendResult(Method::unpackKey(key, key_types), states); });
+    }
+
+    template <class Method>
+    void aggregateInput(IExecutor & input_executor, typename Method::Map & map, Arena & arena)
+    {
+        size_t max_thread_bytes = max_bytes / input_executors.size();
+        size_t bytes = 0;
+        bool accepts_new_groups = true;
+
+        std::vector<typename Method::Key> keys;
+        ChunkColumns columns;
+        Row arguments;
+        std::vector<size_t> spilled_row_indexes;
+        while (auto chunk = input_executor.nextBatch())
+        {
+            evaluateChunk(*chunk, columns);
+            Method::packKeys(columns.keys, chunk->getRowCount(), keys);
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (!accepts_new_groups)
+                {
+                    if (auto * states = Method::find(map, keys[i]))
+                    {
+                        addArguments(*states, columns.arguments, i, arguments);
+                    }
+                    else
+                    {
+                        spilled_row_indexes.push_back(i);
+                    }
+                    continue;
+                }
+
+                auto [states, inserted] = Method::emplace(map, keys[i]);
+                if (inserted)
+                {
+                    states = createStates(arena);
+                    bytes += states_size + Method::getKeyBytes(keys[i]);
+                    accepts_new_groups = !canSpill() || bytes <= max_thread_bytes;
+                }
+                addArguments(states, columns.arguments, i, arguments);
+            }
+
+            if (!spilled_row_indexes.empty())
+            {
+                spillRows(*chunk, columns.keys, spilled_row_indexes);
+                spilled_row_indexes.clear();
+            }
+        }
+    }
+
+    void spillRows(const Chunk & chunk, const std::vector<const Column *> & key_columns, const std::vector<size_t> & row_indexes)
+    {
+        std::lock_guard lock(partitions_mutex);
+        if (partitions.empty())
+        {
+            for (size_t i = 0; i < PartitionCount; ++i)
+            {
+                partitions.push_back(std::make_unique<TemporaryTable>(db, input_schema));
+            }
+        }
+
+        Row key;
+        for (auto row_index : row_indexes)
+        {
+            key.clear();
+            for (const auto * column : key_columns)
+            {
+                key.push_back(column->getValue(row_index));
+            }
+            partitions[getPartitionHash(key, level) % PartitionCount]->insertRow(chunk.getRow(row_index));
+        }
+    }
+
+    template <class Method>
+    void aggregatePartition(TemporaryTablePtr partition, typename Method::Map & result_map)
+    {
+        if (partition->getRowCount() != 0 && input_executors.size() > 1)
+        {
+            /// Keys are spilled only by threads that don't have them, another thread may have kept them in memory.
+            auto rest = std::make_unique<TemporaryTable>(db, input_schema);
+            auto input_executor = createReadFromTableExecutor(partition->getTable(), partition->getSchema());
+            std::vector<typename Method::Key> keys;
+            ChunkColumns columns;
+            Row arguments;
+            while (auto chunk = input_executor->nextBatch())
+            {
+                evaluateChunk(*chunk, columns);
+                Method::packKeys(columns.keys, chunk->getRowCount(), keys);
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    if (auto * states = Method::find(result_map, keys[i]))
+                    {
+                        addArguments(*states, columns.arguments, i, arguments);
+                    }
+                    else
+                    {
+                        rest->insertRow(chunk->getRow(i));
+                    }
+                }
+            }
+            input_executor.reset();
+            partition = std::move(rest);
+        }
+
+        if (partition->getRowCount() == 0)
+        {
+            return;
+        }
+
+        std::vector<ExecutorPtr> partition_input_executors;
+        partition_input_executors.push_back(createReadFromTableExecutor(partition->getTable(), partition->getSchema()));
+        GroupByExecutor partition_group_by(std::move(partition_input_executors), group_by_keys, group_by_expressions, db, max_bytes, level + 1);
+        std::move(partition_group_by.rows.begin(), partition_group_by.rows.end(), std::back_inserter(rows));
+    }
+
+    /// Key and argument columns of one chunk. Input columns are referenced in place, computed ones live in holders.
+    struct ChunkColumns
+    {
+        std::vector<const Column *> keys;
+        std::vector<std::vector<const Column *>> arguments;
+        std::vector<std::optional<Column>> key_holders;
+        std::vector<std::vector<std::optional<Column>>> argument_holders;
+    };
+
+    void evaluateChunk(const Chunk & chunk, ChunkColumns & columns) const
+    {
+        columns.keys.resize(group_by_keys.size());
+        columns.key_holders.resize(group_by_keys.size());
+        for (size_t k = 0; k < group_by_keys.size(); ++k)
+        {
+            columns.keys[k] = &evaluateBatch(*group_by_keys[k].expression, chunk, columns.key_holders[k]);
+        }
+
+        columns.arguments.resize(group_by_expressions.size());
+        columns.argument_holders.resize(group_by_expressions.size());
+        for (size_t j = 0; j < group_by_expressions.size(); ++j)
+        {
+            const auto & arguments = group_by_expressions[j].arguments;
+            columns.arguments[j].resize(arguments.size());
+            columns.argument_holders[j].resize(arguments.size());
+            for (size_t a = 0; a < arguments.size(); ++a)
+            {
+                columns.arguments[j][a] = &evaluateBatch(*arguments[a], chunk, columns.argument_holders[j][a]);
+            }
+        }
+    }
+
+    void addArguments(
+        AggregateDataPtr states, const std::vector<std::vector<const Column *>> & argument_columns, size_t row_index, Row & arguments) const
+    {
+        for (size_t j = 0; j < group_by_expressions.size(); ++j)
+        {
+            arguments.clear();
+            for (const auto * column : argument_columns[j])
+            {
+                arguments.push_back(column->getValue(row_index));
+            }
+            group_by_expressions[j].aggregate_function->add(states + state_offsets[j], arguments);
+        }
+    }
+
+    /// Output row of a group, states are destroyed after their results are taken.
+    void appendResult(Row group_key, AggregateDataPtr states)
+    {
+        for (size_t j = 0; j < group_by_expressions.size(); ++j)
+        {
+            group_key.push_back(group_by_expressions[j].aggregate_function->getResult(states + state_offsets[j]));
+        }
+        rows.push_back(std::move(group_key));
+        destroyStates(states);
+    }
+
+    /// Every state starts at a maximally aligned offset.
+    static size_t alignStateSize(size_t size)
+    {
+        constexpr size_t alignment = alignof(std::max_align_t);
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    AggregateDataPtr createStates(Arena & arena) const
+    {
+        AggregateDataPtr states = arena.alloc(states_size);
+        for (size_t j = 0; j < group_by_expressions.size(); ++j)
+        {
+            group_by_expressions[j].aggregate_function->create(states + state_offsets[j]);
+        }
+        return states;
+    }
+
+    void mergeStates(AggregateDataPtr states, AggregateDataPtr other_states) const
+    {
+        for (size_t j = 0; j < group_by_expressions.size(); ++j)
+        {
+            group_by_expressions[j].aggregate_function->merge(states + state_offsets[j], other_states + state_offsets[j]);
+        }
+    }
+
+    void destroyStates(AggregateDataPtr states) const
+    {
+        for (size_t j = 0; j < group_by_expressions.size(); ++j)
+        {
+            group_by_expressions[j].aggregate_function->destroy(states + state_offsets[j]);
+        }
+    }
+
+    std::vector<ExecutorPtr> input_executors;
+    GroupByKeys group_by_keys;
+    GroupByExpressions group_by_expressions;
+    std::shared_ptr<Database> db;
+    size_t max_bytes;
+    size_t level;
+    std::shared_ptr<Schema> input_schema;
+    std::mutex partitions_mutex;
+    std::vector<TemporaryTablePtr> partitions;
+    Types key_types;
+    std::vector<size_t> state_offsets;
+    size_t states_size = 0;
+    Rows rows;
+    size_t pos = 0;
+    std::shared_ptr<Schema> schema;
+};
 }
 
 ExecutorPtr createReadFromRowsExecutor(Rows rows, std::shared_ptr<Schema> rows_schema)
@@ -382,9 +1993,26 @@ ExecutorPtr createReadFromRowsExecutor(Rows rows, std::shared_ptr<Schema> rows_s
     return std::make_unique<ReadFromRowsExecutor>(rows, rows_schema);
 }
 
-ExecutorPtr createReadFromTableExecutor(std::shared_ptr<ITable> table, std::shared_ptr<Schema> table_schema)
+ExecutorPtr createReadFromTableExecutor(std::shared_ptr<ITable> table, std::shared_ptr<Schema> table_schema, size_t read_ahead_window)
+{
+    auto scan = Scan(table, read_ahead_window);
+    return std::make_unique<ReadFromTableExecutor>(table, std::move(table_schema), scan);
+}
+
+ExecutorPtr createReadFromTableExecutor(
+    std::shared_ptr<ITable> table,
+    std::shared_ptr<Schema> table_schema,
+    PageIndex begin_page_index,
+    PageIndex end_page_index,
+    size_t read_ahead_window)
+{
+    auto scan = Scan(table, read_ahead_window, begin_page_index, end_page_index);
+    return std::make_unique<ReadFromTableExecutor>(table, std::move(table_schema), scan);
+}
+
+ExecutorPtr createReadFromIndexExecutor(std::shared_ptr<IIndex> index, std::shared_ptr<ITable> table, std::shared_ptr<Schema> table_schema)
 {
-    return std::make_unique<ReadFromTableExecutor>(table, table_schema);
+    return std::make_unique<ReadFromIndexExecutor>(std::move(index), std::move(table), std::move(table_schema));
 }
 
 ExecutorPtr createExpressionsExecutor(ExecutorPtr input_executor, Expressions expressions)
@@ -397,19 +2025,95 @@ ExecutorPtr createFilterExecutor(ExecutorPtr input_executor, ExpressionPtr filte
     return std::make_unique<FilterExecutor>(std::move(input_executor), filter_expression);
 }
 
-ExecutorPtr createSortExecutor(ExecutorPtr input_executor, SortExpressions sort_expressions)
+ExecutorPtr createSortExecutor(
+    ExecutorPtr input_executor, SortExpressions sort_expressions, std::shared_ptr<Database> db, size_t max_bytes_in_sort, size_t max_threads)
+{
+    return std::make_unique<SortExecutor>(std::move(input_executor), sort_expressions, std::move(db), max_bytes_in_sort, max_threads);
+}
+
+ExecutorPtr createTopNExecutor(
+    ExecutorPtr input_executor,
+    SortExpressions sort_expressions,
+    size_t limit,
+    std::shared_ptr<Database> db,
+    size_t max_bytes_in_sort,
+    size_t max_threads)
+{
+    return std::make_unique<TopNExecutor>(
+        std::move(input_executor), std::move(sort_expressions), limit, std::move(db), max_bytes_in_sort, max_threads);
+}
+
+ExecutorPtr createLimitExecutor(ExecutorPtr input_executor, size_t limit, size_t offset)
+{
+    return std::make_unique<LimitExecutor>(std::move(input_executor), limit, offset);
+}
+
+ExecutorPtr createJoinExecutor(
+    ExecutorPtr left_input_executor,
+    ExecutorPtr right_input_executor,
+    std::shared_ptr<Database> db,
+    size_t max_bytes_in_join)
+{
+    return std::make_unique<JoinExecutor>(std::move(left_input_executor), std::move(right_input_executor), std::move(db), max_bytes_in_join);
+}
+
+ExecutorPtr createMergeJoinExecutor(ExecutorPtr left_input_executor, ExecutorPtr right_input_executor)
+{
+    return std::make_unique<MergeJoinExecutor>(std::move(left_input_executor), std::move(right_input_executor));
+}
+
+ExecutorPtr createIndexJoinExecutor(
+    ExecutorPtr outer_input_executor,
+    std::shared_ptr<IIndex> index,
+    std::shared_ptr<Schema> index_key_schema,
+    std::shared_ptr<ITable> inner_table,
+    std::shared_ptr<Schema> inner_table_schema)
+{
+    return std::make_unique<IndexJoinExecutor>(std::move(outer_input_executor), std::move(index), *index_key_schema, std::move(inner_table), *inner_table_schema);
+}
+
+ExecutorPtr createGroupByExecutor(
+    ExecutorPtr input_executor,
+    GroupByKeys group_by_keys,
+    GroupByExpressions group_by_expressions,
+    std::shared_ptr<Database> db,
+    size_t max_bytes_in_group_by)
 {
-    return std::make_unique<SortExecutor>(std::move(input_executor), sort_expressions);
+    std::vector<ExecutorPtr> input_executors;
+    input_executors.push_back(std::move(input_executor));
+    return createGroupByExecutor(
+        std::move(input_executors), std::move(group_by_keys), std::move(group_by_expressions), std::move(db), max_bytes_in_group_by);
 }
 
-ExecutorPtr createJoinExecutor(ExecutorPtr left_input_executor, ExecutorPtr right_input_executor)
+ExecutorPtr createGroupByExecutor(
+    std::vector<ExecutorPtr> input_executors,
+    GroupByKeys group_by_keys,
+    GroupByExpressions group_by_expressions,
+    std::shared_ptr<Database> db,
+    size_t max_bytes_in_group_by)
 {
-    return std::make_unique<JoinExecutor>(std::move(left_input_executor), std::move(right_input_executor));
+    return std::make_unique<GroupByExecutor>(
+        std::move(input_executors), std::move(group_by_keys), std::move(group_by_expressions), std::move(db), max_bytes_in_group_by);
 }
 
-ExecutorPtr createGroupByExecutor(ExecutorPtr input_executor, GroupByKeys group_by_keys, GroupByExpressions group_by_expressions)
+std::optional<Chunk> IExecutor::nextBatch()
 {
-    return std::make_unique<GroupByExecutor>(std::move(input_executor), group_by_keys, group_by_expressions);
+    Rows rows;
+    while (rows.size() < ChunkSize)
+    {
+        auto row = next();
+        if (!row)
+        {
+            break;
+        }
+        rows.push_back(std::move(*row));
+    }
+
+    if (rows.empty())
+    {
+        return std::nullopt;
+    }
+    return Chunk::fromRows(rows, getChunkTypes(getOutputSchema(), rows));
 }
 
 RowSet execute(ExecutorPtr executor)
@@ -417,12 +2121,15 @@ RowSet execute(ExecutorPtr executor)
     RowSet result;
     while (true)
     {
-        auto row = executor->next();
-        if (row == std::nullopt)
+        auto chunk = executor->nextBatch();
+        if (chunk == std::nullopt)
         {
             break;
         }
-        result.addRow(std::move(*row));
+        for (size_t i = 0; i < chunk->getRowCount(); ++i)
+        {
+            result.addRow(chunk->getRow(i));
+        }
     }
     return result;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "aggregate_function.h"
+#include "chunk.h"
 #include "expression.h"
+#include "index.h"
 #include "rowset.h"
 #include "table.h"
 #include "scan.h"
@@ -9,6 +11,8 @@
 namespace shdb
 {
 
+class Database;
+
 class IExecutor
 {
 public:
@@ -16,6 +20,11 @@ public:
 
     virtual std::optional<Row> next() = 0;
 
+    /** Next chunk of at most ChunkSize rows, std::nullopt when input is exhausted. Never returns an empty chunk.
+      * Default implementation collects rows from next(). A consumer must use either next() or nextBatch(), not both.
+      */
+    virtual std::optional<Chunk> nextBatch();
+
     virtual std::shared_ptr<Schema> getOutputSchema() = 0;
 };
 
@@ -23,7 +32,19 @@ using ExecutorPtr = std::unique_ptr<IExecutor>;
 
 ExecutorPtr createReadFromRowsExecutor(Rows rows, std::shared_ptr<Schema> rows_schema);
 
-ExecutorPtr createReadFromTableExecutor(std::shared_ptr<ITable> table, std::shared_ptr<Schema> table_schema);
+/// read_ahead_window is the number of pages to prefetch, see QuerySettings::read_ahead_window.
+ExecutorPtr createReadFromTableExecutor(std::shared_ptr<ITable> table, std::shared_ptr<Schema> table_schema, size_t read_ahead_window = 0);
+
+/// Reads pages [begin_page_index, end_page_index) of table.
+ExecutorPtr createReadFromTableExecutor(
+    std::shared_ptr<ITable> table,
+    std::shared_ptr<Schema> table_schema,
+    PageIndex begin_page_index,
+    PageIndex end_page_index,
+    size_t read_ahead_window = 0);
+
+/// Rows of table in the order of index keys, usable as sorted input of a merge join.
+ExecutorPtr createReadFromIndexExecutor(std::shared_ptr<IIndex> index, std::shared_ptr<ITable> table, std::shared_ptr<Schema> table_schema);
 
 ExecutorPtr createExpressionsExecutor(ExecutorPtr input_executor, Expressions expressions);
 
@@ -37,9 +58,56 @@ struct SortExpression
 
 using SortExpressions = std::vector<SortExpression>;
 
-ExecutorPtr createSortExecutor(ExecutorPtr input_executor, SortExpressions sort_expressions);
-
-ExecutorPtr createJoinExecutor(ExecutorPtr left_input_executor, ExecutorPtr right_input_executor);
+/** If db is set and input rows take more than max_bytes_in_sort bytes, the input is sorted in runs
+  * that are written to temporary tables of db and merged on read. Every in-memory sort uses up to max_threads threads.
+  */
+ExecutorPtr createSortExecutor(
+    ExecutorPtr input_executor,
+    SortExpressions sort_expressions,
+    std::shared_ptr<Database> db = nullptr,
+    size_t max_bytes_in_sort = 0,
+    size_t max_threads = 1);
+
+/** First limit rows of the input in sort order, sorted. Input is read on the first pull.
+  * If the kept rows take more than max_bytes_in_sort bytes, the input is sorted as createSortExecutor does instead.
+  */
+ExecutorPtr createTopNExecutor(
+    ExecutorPtr input_executor,
+    SortExpressions sort_expressions,
+    size_t limit,
+    std::shared_ptr<Database> db = nullptr,
+    size_t max_bytes_in_sort = 0,
+    size_t max_threads = 1);
+
+/// At most limit input rows after the first offset rows.
+ExecutorPtr createLimitExecutor(ExecutorPtr input_executor, size_t limit, size_t offset = 0);
+
+/** If db is set and the join has to buffer more than max_bytes_in_join bytes of input rows,
+  * both inputs are partitioned by key into temporary tables of db and partition pairs are joined one by one.
+  * Inputs without common columns are cross joined by scanning the right input, written to a temporary table,
+  * once for every block of left rows that fits into the budget.
+  */
+ExecutorPtr createJoinExecutor(
+    ExecutorPtr left_input_executor,
+    ExecutorPtr right_input_executor,
+    std::shared_ptr<Database> db = nullptr,
+    size_t max_bytes_in_join = 0);
+
+/** Natural join of inputs sorted in ascending order of their common columns, taken in the order of the left input schema,
+  * e.g. read through an index on these columns or sorted by SortExecutor. Keeps only a run of equal right keys in memory.
+  */
+ExecutorPtr createMergeJoinExecutor(ExecutorPtr left_input_executor, ExecutorPtr right_input_executor);
+
+/** Natural join of outer input with inner_table through index on inner_table, whose key columns must be exactly
+  * the common columns of both inputs. Output columns are the inner ones followed by the other outer columns,
+  * the same as of createJoinExecutor with inner_table as the left input.
+  */
+ExecutorPtr createIndexJoinExecutor(
+    ExecutorPtr outer_input_executor,
+    std::shared_ptr<IIndex> index,
+    std::shared_ptr<Schema> index_key_schema,
+    std::shared_ptr<ITable> inner_table,
+    std::shared_ptr<Schema> inner_table_schema);
 
 struct GroupByExpression
 {
@@ -58,7 +126,23 @@ struct GroupByKey
 
 using GroupByKeys = std::vector<GroupByKey>;
 
-ExecutorPtr createGroupByExecutor(ExecutorPtr input_executor, GroupByKeys group_by_keys, GroupByExpressions group_by_expressions);
+/** Hash aggregation. With db and non-zero max_bytes_in_group_by, groups that don't fit into max_bytes_in_group_by bytes
+  * are aggregated partition by partition from temporary tables of db.
+  */
+ExecutorPtr createGroupByExecutor(
+    ExecutorPtr input_executor,
+    GroupByKeys group_by_keys,
+    GroupByExpressions group_by_expressions,
+    std::shared_ptr<Database> db = nullptr,
+    size_t max_bytes_in_group_by = 0);
+
+/// Aggregates every input in its own thread and merges the partial results, inputs must produce the same schema.
+ExecutorPtr createGroupByExecutor(
+    std::vector<ExecutorPtr> input_executors,
+    GroupByKeys group_by_keys,
+    GroupByExpressions group_by_expressions,
+    std::shared_ptr<Database> db = nullptr,
+    size_t max_bytes_in_group_by = 0);
 
 RowSet execute(ExecutorPtr executor);
 
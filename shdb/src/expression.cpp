@@ -2,12 +2,117 @@
 #include "comparator.h"
 #include "iostream"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace shdb
 {
 
 namespace
 {
 
+/// Tight loops over contiguous column data, written to be auto-vectorized.
+template <class T, class Result, class Operation>
+void applyBinaryKernel(const std::vector<T> & lhs, const std::vector<T> & rhs, std::vector<Result> & result, Operation operation)
+{
+    size_t size = lhs.size();
+    result.resize(size);
+    const T * __restrict lhs_data = lhs.data();
+    const T * __restrict rhs_data = rhs.data();
+    Result * __restrict result_data = result.data();
+    for (size_t i = 0; i < size; ++i) {
+        result_data[i] = operation(lhs_data[i], rhs_data[i]);
+    }
+}
+
+#if defined(__AVX2__)
+/// Compare four int64 values per instruction, returns number of processed values.
+template <BinaryOperatorCode code>
+size_t compareInt64Avx2(const int64_t * lhs, const int64_t * rhs, uint8_t * result, size_t size)
+{
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs + i));
+        __m256i mask;
+        if constexpr (code == BinaryOperatorCode::eq) {
+            mask = _mm256_cmpeq_epi64(a, b);
+        } else if constexpr (code == BinaryOperatorCode::ne) {
+            mask = _mm256_xor_si256(_mm256_cmpeq_epi64(a, b), ones);
+        } else if constexpr (code == BinaryOperatorCode::gt) {
+            mask = _mm256_cmpgt_epi64(a, b);
+        } else if constexpr (code == BinaryOperatorCode::lt) {
+            mask = _mm256_cmpgt_epi64(b, a);
+        } else if constexpr (code == BinaryOperatorCode::ge) {
+            mask = _mm256_xor_si256(_mm256_cmpgt_epi64(b, a), ones);
+        } else {
+            mask = _mm256_xor_si256(_mm256_cmpgt_epi64(a, b), ones);
+        }
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(mask));
+        result[i] = bits & 1;
+        result[i + 1] = (bits >> 1) & 1;
+        result[i + 2] = (bits >> 2) & 1;
+        result[i + 3] = (bits >> 3) & 1;
+    }
+    return i;
+}
+#endif
+
+template <BinaryOperatorCode code, class T>
+void compareKernel(const std::vector<T> & lhs, const std::vector<T> & rhs, std::vector<uint8_t> & result)
+{
+    size_t size = lhs.size();
+    result.resize(size);
+    size_t i = 0;
+#if defined(__AVX2__)
+    if constexpr (std::is_same_v<T, int64_t>) {
+        i = compareInt64Avx2<code>(lhs.data(), rhs.data(), result.data(), size);
+    }
+#endif
+    for (; i < size; ++i) {
+        if constexpr (code == BinaryOperatorCode::eq) {
+            result[i] = lhs[i] == rhs[i];
+        } else if constexpr (code == BinaryOperatorCode::ne) {
+            result[i] = lhs[i] != rhs[i];
+        } else if constexpr (code == BinaryOperatorCode::lt) {
+            result[i] = lhs[i] < rhs[i];
+        } else if constexpr (code == BinaryOperatorCode::le) {
+            result[i] = lhs[i] <= rhs[i];
+        } else if constexpr (code == BinaryOperatorCode::gt) {
+            result[i] = lhs[i] > rhs[i];
+        } else {
+            result[i] = lhs[i] >= rhs[i];
+        }
+    }
+}
+
+/// Produces selection bytes, one per row.
+template <class T>
+void compareColumns(BinaryOperatorCode code, const std::vector<T> & lhs, const std::vector<T> & rhs, std::vector<uint8_t> & result)
+{
+    switch (code)
+    {
+    case BinaryOperatorCode::eq: compareKernel<BinaryOperatorCode::eq>(lhs, rhs, result); break;
+    case BinaryOperatorCode::ne: compareKernel<BinaryOperatorCode::ne>(lhs, rhs, result); break;
+    case BinaryOperatorCode::lt: compareKernel<BinaryOperatorCode::lt>(lhs, rhs, result); break;
+    case BinaryOperatorCode::le: compareKernel<BinaryOperatorCode::le>(lhs, rhs, result); break;
+    case BinaryOperatorCode::gt: compareKernel<BinaryOperatorCode::gt>(lhs, rhs, result); break;
+    case BinaryOperatorCode::ge: compareKernel<BinaryOperatorCode::ge>(lhs, rhs, result); break;
+    default:
+        throw std::runtime_error("Unsupported comparison operator");
+    }
+}
+
+/// Chunk with rows of input_chunk that have non-zero selection byte.
+Chunk filterChunk(const Chunk & input_chunk, const std::vector<uint8_t> & selection)
+{
+    Chunk result = input_chunk;
+    result.filter(selection);
+    return result;
+}
+
 class IdentifierExpression : public IExpression
 {
 public:
@@ -26,6 +131,17 @@ public:
         auto value = input_row[pos];
         return value;
     }
+
+    Column evaluateBatch(const Chunk & input_chunk) override
+    {
+        return *getInputColumnOrNull(input_chunk);
+    }
+
+    const Column * getInputColumnOrNull(const Chunk & input_chunk) override
+    {
+        auto pos = input_schema_accessor->getColumnIndexOrThrow(identifier_name);
+        return &input_chunk.getColumn(pos);
+    }
 private:
     std::string identifier_name;
     std::shared_ptr<SchemaAccessor> input_schema_accessor;
@@ -34,13 +150,31 @@ private:
 class NumberConstantExpression : public IExpression
 {
 public:
-    explicit NumberConstantExpression(int64_t value_) : value(value_) { }
+    explicit NumberConstantExpression(int64_t value_) : value(value_), type(Type::int64) { }
+
+    explicit NumberConstantExpression(uint64_t value_) : value(value_), type(Type::uint64) { }
 
-    Type getResultType() override { return Type::int64; }
+    Type getResultType() override { return type; }
 
     Value evaluate(const Row &) override { return value; }
 
+    Column evaluateBatch(const Chunk & input_chunk) override
+    {
+        Column result(type);
+        if (type == Type::uint64)
+        {
+            result.getUInt64Data().assign(input_chunk.getRowCount(), std::get<uint64_t>(value));
+        }
+        else
+        {
+            result.getInt64Data().assign(input_chunk.getRowCount(), std::get<int64_t>(value));
+        }
+        result.getNullMap().assign(input_chunk.getRowCount(), 0);
+        return result;
+    }
+
     Value value;
+    Type type;
 };
 
 class StringConstantExpression : public IExpression
@@ -121,11 +255,120 @@ public:
         }
     }
 
+    Column evaluateBatch(const Chunk & input_chunk) override
+    {
+        if (binary_operator_code == BinaryOperatorCode::land || binary_operator_code == BinaryOperatorCode::lor)
+        {
+            return evaluateLogicalBatch(input_chunk);
+        }
+
+        if (lhs_type != rhs_type || (lhs_type != Type::int64 && lhs_type != Type::uint64))
+        {
+            return IExpression::evaluateBatch(input_chunk);
+        }
+
+        std::optional<Column> lhs_holder;
+        std::optional<Column> rhs_holder;
+        const Column & lhs = shdb::evaluateBatch(*lhs_expression, input_chunk, lhs_holder);
+        const Column & rhs = shdb::evaluateBatch(*rhs_expression, input_chunk, rhs_holder);
+        if (lhs.getType() != lhs_type || rhs.getType() != rhs_type || lhs.hasNulls() || rhs.hasNulls())
+        {
+            return IExpression::evaluateBatch(input_chunk);
+        }
+
+        Column result(getResultType());
+        result.getNullMap().assign(input_chunk.getRowCount(), 0);
+
+        if (result.getType() == Type::boolean)
+        {
+            if (lhs_type == Type::uint64)
+            {
+                compareColumns(binary_operator_code, lhs.getUInt64Data(), rhs.getUInt64Data(), result.getBooleanData());
+            }
+            else
+            {
+                compareColumns(binary_operator_code, lhs.getInt64Data(), rhs.getInt64Data(), result.getBooleanData());
+            }
+            return result;
+        }
+
+        if (lhs_type == Type::uint64)
+        {
+            return IExpression::evaluateBatch(input_chunk);
+        }
+
+        const auto & lhs_data = lhs.getInt64Data();
+        const auto & rhs_data = rhs.getInt64Data();
+
+        auto & result_data = result.getInt64Data();
+        switch (binary_operator_code)
+        {
+        case BinaryOperatorCode::plus:
+            applyBinaryKernel(lhs_data, rhs_data, result_data, [](int64_t a, int64_t b) { return a + b; });
+            break;
+        case BinaryOperatorCode::minus:
+            applyBinaryKernel(lhs_data, rhs_data, result_data, [](int64_t a, int64_t b) { return a - b; });
+            break;
+        case BinaryOperatorCode::mul:
+            applyBinaryKernel(lhs_data, rhs_data, result_data, [](int64_t a, int64_t b) { return a * b; });
+            break;
+        case BinaryOperatorCode::div:
+            applyBinaryKernel(lhs_data, rhs_data, result_data, [](int64_t a, int64_t b) { return a / b; });
+            break;
+        default:
+            throw std::runtime_error("Unsupported operator");
+        }
+        return result;
+    }
+
     const BinaryOperatorCode binary_operator_code;
     ExpressionPtr lhs_expression;
     ExpressionPtr rhs_expression;
     Type lhs_type;
     Type rhs_type;
+
+private:
+    /// Keeps short-circuit semantics: rhs is evaluated only for rows where lhs does not decide the result.
+    Column evaluateLogicalBatch(const Chunk & input_chunk)
+    {
+        Column lhs = lhs_expression->evaluateBatch(input_chunk);
+        if (lhs.getType() != Type::boolean || lhs.hasNulls())
+        {
+            return IExpression::evaluateBatch(input_chunk);
+        }
+
+        bool is_and = binary_operator_code == BinaryOperatorCode::land;
+        auto & lhs_data = lhs.getBooleanData();
+        std::vector<uint8_t> need_rhs(lhs_data.size());
+        size_t need_rhs_count = 0;
+        for (size_t i = 0; i < lhs_data.size(); ++i)
+        {
+            need_rhs[i] = (lhs_data[i] != 0) == is_and;
+            need_rhs_count += need_rhs[i];
+        }
+
+        if (need_rhs_count == 0)
+        {
+            return lhs;
+        }
+
+        Column rhs = need_rhs_count == lhs_data.size() ? rhs_expression->evaluateBatch(input_chunk)
+                                                      : rhs_expression->evaluateBatch(filterChunk(input_chunk, need_rhs));
+        if (rhs.getType() != Type::boolean || rhs.hasNulls())
+        {
+            return IExpression::evaluateBatch(input_chunk);
+        }
+
+        const auto & rhs_data = rhs.getBooleanData();
+        for (size_t i = 0, rhs_index = 0; i < lhs_data.size(); ++i)
+        {
+            if (need_rhs[i])
+            {
+                lhs_data[i] = rhs_data[rhs_index++];
+            }
+        }
+        return lhs;
+    }
 };
 
 class UnaryOperatorExpression : public IExpression
@@ -162,6 +405,34 @@ public:
         }
     }
 
+    Column evaluateBatch(const Chunk & input_chunk) override
+    {
+        Column result = expression->evaluateBatch(input_chunk);
+        if (result.getType() != expression_type || result.hasNulls())
+        {
+            return IExpression::evaluateBatch(input_chunk);
+        }
+
+        if (unary_operator_code == UnaryOperatorCode::lnot && expression_type == Type::boolean)
+        {
+            for (auto & value : result.getBooleanData())
+            {
+                value = !value;
+            }
+            return result;
+        }
+        if (unary_operator_code == UnaryOperatorCode::uminus && expression_type == Type::int64)
+        {
+            for (auto & value : result.getInt64Data())
+            {
+                value = -value;
+            }
+            return result;
+        }
+
+        return IExpression::evaluateBatch(input_chunk);
+    }
+
     const UnaryOperatorCode unary_operator_code;
     ExpressionPtr expression;
     Type expression_type;
@@ -169,6 +440,65 @@ public:
 
 }
 
+Column IExpression::evaluateBatch(const Chunk & input_chunk)
+{
+    Column result(getResultType());
+    result.reserve(input_chunk.getRowCount());
+    for (size_t i = 0; i < input_chunk.getRowCount(); ++i)
+    {
+        result.append(evaluate(input_chunk.getRow(i)));
+    }
+    return result;
+}
+
+const Column & evaluateBatch(IExpression & expression, const Chunk & chunk, std::optional<Column> & holder)
+{
+    if (const auto * column = expression.getInputColumnOrNull(chunk))
+    {
+        return *column;
+    }
+    holder = expression.evaluateBatch(chunk);
+    return *holder;
+}
+
+namespace
+{
+
+bool isComparison(BinaryOperatorCode code)
+{
+    switch (code)
+    {
+    case BinaryOperatorCode::eq:
+    case BinaryOperatorCode::ne:
+    case BinaryOperatorCode::lt:
+    case BinaryOperatorCode::le:
+    case BinaryOperatorCode::gt:
+    case BinaryOperatorCode::ge:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// Non-negative number literal compared with an uint64 expression becomes an uint64 constant,
+/// so both sides have one type and the comparison is done by value on both evaluation paths.
+void coerceNumberConstant(ExpressionPtr & constant_expression, const ExpressionPtr & other_expression)
+{
+    auto * number = dynamic_cast<NumberConstantExpression *>(constant_expression.get());
+    if (!number || number->type != Type::int64 || other_expression->getResultType() != Type::uint64)
+    {
+        return;
+    }
+
+    int64_t value = std::get<int64_t>(number->value);
+    if (value >= 0)
+    {
+        constant_expression = std::make_shared<NumberConstantExpression>(static_cast<uint64_t>(value));
+    }
+}
+
+}
+
 ExpressionPtr buildExpression(const ASTPtr & expression, const std::shared_ptr<SchemaAccessor> & input_schema_accessor)
 {
     switch (expression->type)
@@ -192,6 +522,11 @@ ExpressionPtr buildExpression(const ASTPtr & expression, const std::shared_ptr<S
         auto binary_operator_expression = std::reinterpret_pointer_cast<ASTBinaryOperator>(expression);
         auto lhs_expression = buildExpression(binary_operator_expression->getLHS(), input_schema_accessor);
         auto rhs_expression = buildExpression(binary_operator_expression->getRHS(), input_schema_accessor);
+        if (isComparison(binary_operator_expression->operator_code))
+        {
+            coerceNumberConstant(lhs_expression, rhs_expression);
+            coerceNumberConstant(rhs_expression, lhs_expression);
+        }
         return std::make_shared<BinaryOperatorExpression>(binary_operator_expression->operator_code, lhs_expression, rhs_expression);
     }
     case ASTType::unaryOperator:
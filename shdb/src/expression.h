@@ -1,7 +1,10 @@
 #pragma once
 
+#include <optional>
+
 #include "accessors.h"
 #include "ast.h"
+#include "chunk.h"
 
 namespace shdb
 {
@@ -14,11 +17,22 @@ public:
     virtual Type getResultType() = 0;
 
     virtual Value evaluate(const Row & input_row) = 0;
+
+    /// Evaluate expression for every row of chunk. Default implementation evaluates row by row.
+    virtual Column evaluateBatch(const Chunk & input_chunk);
+
+    /// Column of input_chunk the expression is equal to, if any, so it can be read without being copied.
+    virtual const Column * getInputColumnOrNull(const Chunk &) { return nullptr; }
 };
 
 using ExpressionPtr = std::shared_ptr<IExpression>;
 using Expressions = std::vector<ExpressionPtr>;
 
+/** Result of expression for every row of chunk. A column of chunk itself is returned by reference,
+  * other results are evaluated into holder.
+  */
+const Column & evaluateBatch(IExpression & expression, const Chunk & chunk, std::optional<Column> & holder);
+
 ExpressionPtr buildExpression(const ASTPtr & expression, const std::shared_ptr<SchemaAccessor> & input_schema_accessor);
 
 Expressions buildExpressions(const ASTs & expressions, const std::shared_ptr<SchemaAccessor> & input_schema_accessor);
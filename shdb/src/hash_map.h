@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace shdb
+{
+
+/** Values of up to N fixed-width columns (int64, uint64, boolean) packed into integers,
+  * bit i of null_mask is set if column i is Null, the packed value of a Null column is zero.
+  */
+template <size_t N>
+struct FixedKey
+{
+    std::array<uint64_t, N> values{};
+    uint64_t null_mask = 0;
+
+    bool operator==(const FixedKey &) const = default;
+};
+
+template <size_t N>
+struct FixedKeyHash
+{
+    size_t operator()(const FixedKey<N> & key) const
+    {
+        uint64_t hash = key.null_mask;
+        for (auto value : key.values) {
+            /// Finalizer of MurmurHash3 over the running combination.
+            hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+            hash ^= hash >> 33;
+            hash *= 0xFF51AFD7ED558CCDULL;
+            hash ^= hash >> 33;
+        }
+        return hash;
+    }
+};
+
+/** Open addressing hash map with linear probing for small trivially copyable keys.
+  * Cells live in one array of power of two size that is doubled when half full,
+  * so a lookup touches one or two cache lines and an insert never allocates per element.
+  * Elements can't be erased, references to mapped values are invalidated by inserts.
+  */
+template <class Key, class Mapped, class Hash>
+class FixedHashMap
+{
+public:
+    explicit FixedHashMap(size_t initial_capacity = 256) : cells(initial_capacity), mask(initial_capacity - 1) { }
+
+    /// Mapped value of key, value-initialized if key was inserted by this call. Second is true if it was.
+    std::pair<Mapped &, bool> emplace(const Key & key)
+    {
+        if ((element_count + 1) * 2 > cells.size()) {
+            grow();
+        }
+
+        size_t index = hash(key) & mask;
+        while (cells[index].occupied) {
+            if (cells[index].key == key) {
+                return {cells[index].mapped, false};
+            }
+            index = (index + 1) & mask;
+        }
+
+        auto & cell = cells[index];
+        cell.occupied = true;
+        cell.key = key;
+        element_count += 1;
+        return {cell.mapped, true};
+    }
+
+    /// Mapped value of key or nullptr if there is no such key.
+    Mapped * find(const Key & key)
+    {
+        size_t index = hash(key) & mask;
+        while (cells[index].occupied) {
+            if (cells[index].key == key) {
+                return &cells[index].mapped;
+            }
+            index = (index + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    template <class Function>
+    void forEach(Function && function)
+    {
+        for (auto & cell : cells) {
+            if (cell.occupied) {
+                function(cell.key, cell.mapped);
+            }
+        }
+    }
+
+    size_t size() const { return element_count; }
+
+private:
+    struct Cell
+    {
+        Key key{};
+        Mapped mapped{};
+        bool occupied = false;
+    };
+
+    void grow()
+    {
+        std::vector<Cell> old_cells(cells.size() * 2);
+        old_cells.swap(cells);
+        mask = cells.size() - 1;
+
+        for (auto & old_cell : old_cells) {
+            if (!old_cell.occupied) {
+                continue;
+            }
+            size_t index = hash(old_cell.key) & mask;
+            while (cells[index].occupied) {
+                index = (index + 1) & mask;
+            }
+            cells[index] = std::move(old_cell);
+        }
+    }
+
+    std::vector<Cell> cells;
+    size_t mask;
+    size_t element_count = 0;
+    Hash hash;
+};
+
+}
@@ -8,7 +8,11 @@
 #include "lexer.h"
 #include "parser.hpp"
 #include "row.h"
+#include "spill.h"
+#include <limits>
+#include <optional>
 #include <regex>
+#include <set>
 
 namespace shdb
 {
@@ -19,6 +23,11 @@ Interpreter::Interpreter(std::shared_ptr<Database> db_) : db(std::move(db_))
 }
 
 RowSet Interpreter::execute(const std::string & query)
+{
+    return execute(query, QuerySettings{});
+}
+
+RowSet Interpreter::execute(const std::string & query, const QuerySettings & settings)
 {
     Lexer lexer(query.c_str(), query.c_str() + query.size());
     ASTPtr result;
@@ -85,7 +94,7 @@ RowSet Interpreter::execute(const std::string & query)
 
             if (!result || !error.empty())
                 throw std::runtime_error("Bad input: " + error);
-            return executeSelect(std::static_pointer_cast<ASTSelectQuery>(result));
+            return executeSelect(std::static_pointer_cast<ASTSelectQuery>(result), settings);
         }
         case ASTType::insertQuery:
             executeInsert(std::static_pointer_cast<ASTInsertQuery>(result));
@@ -103,7 +112,48 @@ RowSet Interpreter::execute(const std::string & query)
     return RowSet{};
 }
 
-RowSet Interpreter::executeSelect(const ASTSelectQueryPtr & select_query_ptr)
+void Interpreter::attachIndex(const std::string & table, std::shared_ptr<IIndex> index, std::shared_ptr<Schema> key_schema)
+{
+    indexes[table].push_back({std::move(index), std::move(key_schema)});
+}
+
+const Interpreter::AttachedIndex *
+Interpreter::findJoinIndex(const std::string & table, const Schema & table_schema, const Schema & other_schema) const
+{
+    auto it = indexes.find(table);
+    if (it == indexes.end())
+    {
+        return nullptr;
+    }
+
+    std::set<std::string> join_columns;
+    for (const auto & column : table_schema)
+    {
+        for (const auto & other_column : other_schema)
+        {
+            if (column.name == other_column.name)
+            {
+                join_columns.insert(column.name);
+            }
+        }
+    }
+
+    for (const auto & attached_index : it->second)
+    {
+        std::set<std::string> key_columns;
+        for (const auto & column : *attached_index.key_schema)
+        {
+            key_columns.insert(column.name);
+        }
+        if (!join_columns.empty() && key_columns == join_columns)
+        {
+            return &attached_index;
+        }
+    }
+    return nullptr;
+}
+
+RowSet Interpreter::executeSelect(const ASTSelectQueryPtr & select_query_ptr, const QuerySettings & settings)
 {
     if (select_query_ptr->from.empty())
     {
@@ -117,18 +167,24 @@ RowSet Interpreter::executeSelect(const ASTSelectQueryPtr & select_query_ptr)
     else
     {
         ExecutorPtr executor = nullptr;
+        size_t read_ahead_window = settings.concurrent_page_reads ? settings.read_ahead_window : 0;
         for (auto table_name : select_query_ptr->from)
         {
             auto table = db->getTable(table_name);
             auto schema = db->findTableSchema(table_name);
             if (executor != nullptr)
             {
-                auto tmp_executor = createReadFromTableExecutor(table, schema);
-                executor = createJoinExecutor(std::move(tmp_executor), std::move(executor));
+                if (const auto * join_index = findJoinIndex(table_name, *schema, *executor->getOutputSchema()))
+                {
+                    executor = createIndexJoinExecutor(std::move(executor), join_index->index, join_index->key_schema, table, schema);
+                    continue;
+                }
+                auto tmp_executor = createReadFromTableExecutor(table, schema, read_ahead_window);
+                executor = createJoinExecutor(std::move(tmp_executor), std::move(executor), db, settings.max_bytes_in_join);
             }
             else 
             {
-                executor = createReadFromTableExecutor(table, schema);
+                executor = createReadFromTableExecutor(table, schema, read_ahead_window);
             }
         }
         auto schema_accessor = std::make_shared<SchemaAccessor>(SchemaAccessor(executor->getOutputSchema()));
@@ -181,7 +237,35 @@ RowSet Interpreter::executeSelect(const ASTSelectQueryPtr & select_query_ptr)
                 keys.emplace_back(buildExpression(expression, schema_accessor), expression->getName());        
             }
 
-            executor = createGroupByExecutor(std::move(executor), keys, expressions);
+            /// A single table is split into page ranges that are aggregated in parallel, each with its own scan and filter.
+            /// Every range is read by its own thread, which the buffer pool must allow.
+            std::vector<ExecutorPtr> input_executors;
+            if (settings.max_threads > 1 && settings.concurrent_page_reads && select_query_ptr->from.size() == 1)
+            {
+                auto table = db->getTable(select_query_ptr->from[0]);
+                auto schema = db->findTableSchema(select_query_ptr->from[0]);
+                PageIndex page_count = table->getPageCount();
+                size_t stream_count = std::min<size_t>(settings.max_threads, page_count);
+                for (size_t i = 0; i < stream_count; ++i)
+                {
+                    auto input_executor = createReadFromTableExecutor(
+                        table, schema, page_count * i / stream_count, page_count * (i + 1) / stream_count, read_ahead_window);
+                    if (select_query_ptr->getWhere())
+                    {
+                        input_executor = createFilterExecutor(std::move(input_executor), buildExpression(select_query_ptr->getWhere(), schema_accessor));
+                    }
+                    input_executors.push_back(std::move(input_executor));
+                }
+            }
+
+            if (input_executors.size() > 1)
+            {
+                executor = createGroupByExecutor(std::move(input_executors), keys, expressions, db, settings.max_bytes_in_group_by);
+            }
+            else
+            {
+                executor = createGroupByExecutor(std::move(executor), keys, expressions, db, settings.max_bytes_in_group_by);
+            }
             schema_accessor = std::make_shared<SchemaAccessor>(SchemaAccessor(executor->getOutputSchema()));
         }
     
@@ -191,6 +275,17 @@ RowSet Interpreter::executeSelect(const ASTSelectQueryPtr & select_query_ptr)
             executor = createFilterExecutor(std::move(executor), expression);
         }
 
+        std::optional<size_t> limit;
+        size_t offset = 0;
+        if (select_query_ptr->getLimit())
+        {
+            limit = std::static_pointer_cast<ASTLiteral>(select_query_ptr->getLimit())->integer_value;
+        }
+        if (select_query_ptr->getOffset())
+        {
+            offset = std::static_pointer_cast<ASTLiteral>(select_query_ptr->getOffset())->integer_value;
+        }
+
         if (select_query_ptr->getOrder())
         {
             SortExpressions expressions;
@@ -208,12 +303,27 @@ RowSet Interpreter::executeSelect(const ASTSelectQueryPtr & select_query_ptr)
                     expressions.push_back({buildExpression(expr->getExpr(), schema_accessor), expr->desc});
                 }
             }
-            executor = createSortExecutor(std::move(executor), expressions);
+            if (limit)
+            {
+                /// Rows skipped by OFFSET are never returned if LIMIT is zero.
+                size_t top_n = *limit == 0 ? 0 : *limit + offset;
+                executor = createTopNExecutor(
+                    std::move(executor), expressions, top_n, db, settings.max_bytes_in_sort, settings.max_threads);
+            }
+            else
+            {
+                executor = createSortExecutor(std::move(executor), expressions, db, settings.max_bytes_in_sort, settings.max_threads);
+            }
         }
 
         auto children = select_query_ptr->getProjection()->getChildren();
         auto expressions = buildExpressions(children, schema_accessor);
         executor  = createExpressionsExecutor(std::move(executor), expressions);
+
+        if (limit || offset != 0)
+        {
+            executor = createLimitExecutor(std::move(executor), limit.value_or(std::numeric_limits<size_t>::max()), offset);
+        }
     
         return shdb::execute(std::move(executor));
     }
@@ -242,17 +352,49 @@ void Interpreter::executeInsert(const std::shared_ptr<ASTInsertQuery> & insert_q
         }
     }
 
-    table->insertRow(row_set.getRows()[0]);
+    const auto & row = row_set.getRows()[0];
+    auto row_id = table->insertRow(row);
+
+    auto it = indexes.find(insert_query->table);
+    if (it == indexes.end())
+    {
+        return;
+    }
+    for (const auto & attached_index : it->second)
+    {
+        IndexKey key;
+        for (const auto & key_column : *attached_index.key_schema)
+        {
+            for (size_t i = 0; i < schema->size(); ++i)
+            {
+                if ((*schema)[i].name == key_column.name)
+                {
+                    key.push_back(row[i]);
+                    break;
+                }
+            }
+        }
+        attached_index.index->insert(key, row_id);
+    }
 }
 
 void Interpreter::executeCreate(const ASTCreateQueryPtr & create_query)
 {
+    if (isTemporaryTableName(create_query->table))
+    {
+        throw std::runtime_error("Table name " + create_query->table + " is reserved for temporary tables");
+    }
     db->createTable(create_query->table, create_query->schema);
 }
 
 void Interpreter::executeDrop(const ASTDropQueryPtr & drop_query)
 {
+    if (isTemporaryTableName(drop_query->table))
+    {
+        throw std::runtime_error("Table name " + drop_query->table + " is reserved for temporary tables");
+    }
     db->dropTable(drop_query->table);
+    indexes.erase(drop_query->table);
 }
 
 }
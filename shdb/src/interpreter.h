@@ -3,7 +3,11 @@
 #include "aggregate_function.h"
 #include "ast.h"
 #include "database.h"
+#include "index.h"
 #include "rowset.h"
+#include "settings.h"
+
+#include <unordered_map>
 
 namespace shdb
 {
@@ -15,14 +19,31 @@ public:
 
     RowSet execute(const std::string & query);
 
+    RowSet execute(const std::string & query, const QuerySettings & settings);
+
+    /** Make index on key_schema columns of table available to queries. Joins with the table use the index
+      * when it covers exactly the join columns, INSERT adds new rows to it. The caller owns the index storage,
+      * and the index has to contain the rows already in the table.
+      */
+    void attachIndex(const std::string & table, std::shared_ptr<IIndex> index, std::shared_ptr<Schema> key_schema);
+
 private:
-    RowSet executeSelect(const ASTSelectQueryPtr & select_query);
+    struct AttachedIndex
+    {
+        std::shared_ptr<IIndex> index;
+        std::shared_ptr<Schema> key_schema;
+    };
+
+    const AttachedIndex * findJoinIndex(const std::string & table, const Schema & table_schema, const Schema & other_schema) const;
+
+    RowSet executeSelect(const ASTSelectQueryPtr & select_query, const QuerySettings & settings);
     void executeInsert(const ASTInsertQueryPtr & insert_query);
     void executeCreate(const ASTCreateQueryPtr & create_query);
     void executeDrop(const ASTDropQueryPtr & drop_query);
 
     std::shared_ptr<Database> db;
     AggregateFunctionFactory aggregate_function_factory;
+    std::unordered_map<std::string, std::vector<AttachedIndex>> indexes;
 };
 
 }
@@ -0,0 +1,153 @@
+#include "key_encoding.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+
+namespace shdb
+{
+
+namespace
+{
+
+void appendBigEndian(std::string & key, uint64_t value)
+{
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        key.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+uint64_t readBigEndian(const uint8_t *& data)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+        value = (value << 8) | *data++;
+    }
+    return value;
+}
+
+/// Index of the alternative of Value that holds values of column.
+size_t getValueIndex(const ColumnSchema & column)
+{
+    switch (column.type) {
+        case Type::uint64:
+            return Value(uint64_t(0)).index();
+        case Type::int64:
+            return Value(int64_t(0)).index();
+        case Type::boolean:
+            return Value(false).index();
+        default:
+            return Value(std::string()).index();
+    }
+}
+
+}
+
+void appendNormalizedValue(std::string & key, const Value & value, bool desc)
+{
+    size_t begin = key.size();
+    key.push_back(static_cast<char>(value.index()));
+
+    std::visit(
+        [&key](const auto & alternative)
+        {
+            using T = std::decay_t<decltype(alternative)>;
+            if constexpr (std::is_same_v<T, uint64_t>) {
+                appendBigEndian(key, alternative);
+            } else if constexpr (std::is_same_v<T, int64_t>) {
+                appendBigEndian(key, static_cast<uint64_t>(alternative) ^ (uint64_t(1) << 63));
+            } else if constexpr (std::is_same_v<T, bool>) {
+                key.push_back(static_cast<char>(alternative));
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                for (char c : alternative) {
+                    key.push_back(c);
+                    if (c == '\0') {
+                        key.push_back('\xFF');
+                    }
+                }
+                key.push_back('\0');
+                key.push_back('\0');
+            }
+        },
+        value);
+
+    if (desc) {
+        for (size_t i = begin; i < key.size(); ++i) {
+            key[i] = static_cast<char>(~key[i]);
+        }
+    }
+}
+
+std::string getNormalizedKey(const Row & row)
+{
+    std::string key;
+    for (const auto & value : row) {
+        appendNormalizedValue(key, value);
+    }
+    return key;
+}
+
+size_t getFixedNormalizedValueSize(const ColumnSchema & column)
+{
+    switch (column.type) {
+        case Type::uint64:
+        case Type::int64:
+            return 1 + sizeof(uint64_t);
+        case Type::boolean:
+            return 1 + 1;
+        case Type::varchar:
+            return 1 + column.length;
+        default:
+            throw std::runtime_error("Column " + column.name + " has no fixed size normalized value");
+    }
+}
+
+void appendFixedNormalizedValue(std::string & key, const Value & value, const ColumnSchema & column)
+{
+    size_t end = key.size() + getFixedNormalizedValueSize(column);
+    if (value.index() != getValueIndex(column)) {
+        key.push_back(static_cast<char>(value.index()));
+    } else if (column.type == Type::varchar) {
+        const auto & str = std::get<std::string>(value);
+        if (str.size() > static_cast<size_t>(column.length)) {
+            throw std::runtime_error("Value of column " + column.name + " is longer than the column");
+        }
+        key.push_back(static_cast<char>(value.index()));
+        key += str;
+    } else {
+        appendNormalizedValue(key, value);
+    }
+    key.resize(end, '\0');
+}
+
+Value readFixedNormalizedValue(const uint8_t *& data, const ColumnSchema & column)
+{
+    const uint8_t * end = data + getFixedNormalizedValueSize(column);
+    Value value;
+    if (*data++ == Value(Null{}).index()) {
+        value = Null{};
+    } else {
+        switch (column.type) {
+            case Type::uint64:
+                value = readBigEndian(data);
+                break;
+            case Type::int64:
+                value = static_cast<int64_t>(readBigEndian(data) ^ (uint64_t(1) << 63));
+                break;
+            case Type::boolean:
+                value = *data != 0;
+                break;
+            default: {
+                const char * str = reinterpret_cast<const char *>(data);
+                value = std::string(str, strnlen(str, column.length));
+                break;
+            }
+        }
+    }
+    data = end;
+    return value;
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "row.h"
+#include "schema.h"
+
+namespace shdb
+{
+
+/** Normalized keys are byte strings whose memcmp order is the compareValue order of the encoded values.
+  * Every value starts with the index of its alternative in Value, so Null goes first, followed by
+  *  - unsigned integers in big-endian,
+  *  - signed integers in big-endian with the sign bit flipped,
+  *  - booleans as one byte,
+  *  - strings with 0x00 escaped as 0x00 0xFF and terminated by 0x00 0x00.
+  * No encoded value is a prefix of another one, so encoded values of several columns are simply concatenated,
+  * and inverting every byte of an encoded value gives the descending order.
+  */
+void appendNormalizedValue(std::string & key, const Value & value, bool desc = false);
+
+/// Normalized key of all values of row in ascending order.
+std::string getNormalizedKey(const Row & row);
+
+/// Bytes appendFixedNormalizedValue writes for every value of column. Strings of unbounded length have no fixed size and throw.
+size_t getFixedNormalizedValueSize(const ColumnSchema & column);
+
+/** Normalized value of a fixed size for column, in the same order as appendNormalizedValue.
+  * Varchar values have no zero bytes, so they are padded with zero bytes up to the column length instead of being escaped,
+  * and Null or a value of an alternative other than the column type is followed by zero bytes, as its first byte alone decides the order.
+  */
+void appendFixedNormalizedValue(std::string & key, const Value & value, const ColumnSchema & column);
+
+/// Value written by appendFixedNormalizedValue for column, data is moved past it.
+Value readFixedNormalizedValue(const uint8_t *& data, const ColumnSchema & column);
+
+}
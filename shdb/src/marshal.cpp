@@ -3,6 +3,7 @@
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <string_view>
 
 namespace shdb
 {
@@ -26,6 +27,36 @@ T deserializeValue(uint8_t *& data)
     return result;
 }
 
+template <class T>
+T readValue(const uint8_t * data)
+{
+    T result{};
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+template <class T>
+int16_t compareScalars(const T & lhs, const T & rhs)
+{
+    return lhs < rhs ? -1 : lhs != rhs;
+}
+
+/// Index of the alternative of Value a non-null column of type is deserialized to.
+size_t getValueIndex(Type type)
+{
+    switch (type)
+    {
+        case Type::uint64:
+            return Value(uint64_t(0)).index();
+        case Type::int64:
+            return Value(int64_t(0)).index();
+        case Type::boolean:
+            return Value(false).index();
+        default:
+            return Value(std::string()).index();
+    }
+}
+
 }
 
 size_t Marshal::calculateFixedRowSpace(uint64_t nulls) const
@@ -224,4 +255,63 @@ Row Marshal::deserializeRow(uint8_t * data) const
     return row;
 }
 
+int16_t Marshal::compareWithRow(const uint8_t * data, const Row & row) const
+{
+    assert(row.size() >= schema->size());
+    const auto * start = data;
+    auto nulls = readValue<uint64_t>(data);
+    data += sizeof(uint64_t);
+    for (size_t index = 0; index < schema->size(); ++index)
+    {
+        const auto & column = (*schema)[index];
+        const auto & value = row[index];
+
+        /// Values of different alternatives are ordered by alternative, as in std::variant comparison.
+        size_t value_index = (nulls & (1UL << index)) ? Value(Null{}).index() : getValueIndex(column.type);
+        if (value_index != value.index())
+            return value_index < value.index() ? -1 : 1;
+        if (nulls & (1UL << index))
+            continue;
+
+        int16_t result = 0;
+        switch (column.type)
+        {
+            case Type::boolean: {
+                result = compareScalars(static_cast<bool>(readValue<uint8_t>(data)), std::get<bool>(value));
+                data += sizeof(uint8_t);
+                break;
+            }
+            case Type::uint64: {
+                result = compareScalars(readValue<uint64_t>(data), std::get<uint64_t>(value));
+                data += sizeof(uint64_t);
+                break;
+            }
+            case Type::int64: {
+                result = compareScalars(readValue<int64_t>(data), std::get<int64_t>(value));
+                data += sizeof(int64_t);
+                break;
+            }
+            case Type::varchar: {
+                auto length = strnlen(reinterpret_cast<const char *>(data), column.length);
+                auto str = std::string_view(reinterpret_cast<const char *>(data), length);
+                result = compareScalars(str, std::string_view(std::get<std::string>(value)));
+                data += column.length;
+                break;
+            }
+            case Type::string: {
+                auto length = readValue<uint64_t>(data);
+                auto offset = readValue<uint64_t>(data + sizeof(uint64_t));
+                auto str = std::string_view(reinterpret_cast<const char *>(start + offset), length);
+                result = compareScalars(str, std::string_view(std::get<std::string>(value)));
+                data += 2 * sizeof(uint64_t);
+                break;
+            }
+        }
+
+        if (result != 0)
+            return result;
+    }
+    return 0;
+}
+
 }
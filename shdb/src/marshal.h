@@ -21,6 +21,11 @@ public:
 
     Row deserializeRow(uint8_t * data) const;
 
+    /** Compare row serialized at data with row as compareRows(deserializeRow(data), row) does,
+      * reading values in place without materializing the serialized row.
+      */
+    int16_t compareWithRow(const uint8_t * data, const Row & row) const;
+
 private:
     size_t calculateFixedRowSpace(uint64_t nulls) const;
 
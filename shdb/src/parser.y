@@ -51,6 +51,8 @@
 %token ORDER "ORDER BY"
 %token GROUP "GROUP BY"
 %token HAVING "HAVING"
+%token LIMIT "LIMIT"
+%token OFFSET "OFFSET"
 
 %token <std::string> MIN "min"
 %token <std::string> MAX "max"
@@ -69,7 +71,7 @@
 %type <ASTListPtr> projection
 
 %type <std::vector<std::string>> FROM_POINT
-%type <ASTPtr> WHERE_POINT HAVING_POINT
+%type <ASTPtr> WHERE_POINT HAVING_POINT LIMIT_POINT OFFSET_POINT
 %type <ASTListPtr> GROUP_POINT ORDER_POINT
 
 %left "||"
@@ -88,7 +90,7 @@ input: row { result = $1; }
 row: CREATE NAME "(" schema ")" { $$ = newCreateQuery($2, $4); }
     | DROP NAME { $$ = newDropQuery($2); }
     | INSERT NAME VALUES "(" projection ")" { $$ = newInsertQuery($2, $5); }
-    | SELECT projection FROM_POINT WHERE_POINT GROUP_POINT HAVING_POINT ORDER_POINT { $$ = newSelectQuery($2, $3, $4, $5, $6, $7); }
+    | SELECT projection FROM_POINT WHERE_POINT GROUP_POINT HAVING_POINT ORDER_POINT LIMIT_POINT OFFSET_POINT { $$ = newSelectQuery($2, $3, $4, $5, $6, $7, $8, $9); }
 
 
 FROM_POINT: %empty { $$ = {}; }
@@ -111,6 +113,12 @@ ORDER_POINT: %empty { $$ = nullptr; }
     | ORDER_POINT "," expr { $1->append(newOrder($3, false)); $$ = std::move($1); }
     | ORDER_POINT "," expr DESC { $1->append(newOrder($3, true)); $$ = std::move($1); }
 
+LIMIT_POINT: %empty { $$ = nullptr; }
+    | LIMIT NUM { $$ = newNumberLiteral($2); }
+
+OFFSET_POINT: %empty { $$ = nullptr; }
+    | OFFSET NUM { $$ = newNumberLiteral($2); }
+
 schema: NAME TYPE { $$ = {{$1, toType($2)}}; }
     | NAME TYPE "(" NUM ")" { $$ = {{$1, toType($2), $4}}; }
     | schema COMMA NAME TYPE { $1.push_back({$3, toType($4)});  $$ = std::move($1); }
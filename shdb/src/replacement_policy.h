@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace shdb
+{
+
+enum class ReplacementPolicyType
+{
+    clock,
+    two_queue
+};
+
+/** Replacement policy decides which cache slot to evict.
+  * Cache owns keys, values and pins, policy only sees slot indexes and keys moving in and out of them.
+  * pickVictim must only return slots with zero pins.
+  */
+template <class Key>
+class IReplacementPolicy
+{
+public:
+    virtual ~IReplacementPolicy() = default;
+
+    virtual void onHit(size_t slot) = 0;
+
+    virtual void onInsert(size_t slot, const Key & key) = 0;
+
+    virtual void onEvict(size_t slot, const Key & key) = 0;
+
+    virtual std::optional<size_t> pickVictim(const std::vector<int> & pins) = 0;
+};
+
+template <class Key>
+using ReplacementPolicyPtr = std::unique_ptr<IReplacementPolicy<Key>>;
+
+/// Second chance clock, every hit gives a slot one more turn of the hand, up to MaxAmount.
+template <class Key>
+class ClockReplacementPolicy : public IReplacementPolicy<Key>
+{
+public:
+    explicit ClockReplacementPolicy(size_t size) : amounts(size) { }
+
+    void onHit(size_t slot) override { amounts[slot] = std::min(MaxAmount, amounts[slot] + 1); }
+
+    void onInsert(size_t slot, const Key &) override { amounts[slot] = 1; }
+
+    void onEvict(size_t slot, const Key &) override { amounts[slot] = 0; }
+
+    std::optional<size_t> pickVictim(const std::vector<int> & pins) override
+    {
+        /// Every full turn decreases each amount at least by one, so after MaxAmount + 1 turns
+        /// an unpinned slot must have been found.
+        size_t steps_left = (MaxAmount + 1) * amounts.size();
+
+        while (steps_left > 0) {
+            if (amounts[hand] > 0)
+            {
+                amounts[hand] -= 1;
+            }
+            else if (pins[hand] == 0)
+            {
+                return hand;
+            }
+
+            hand++;
+            hand %= amounts.size();
+            steps_left--;
+        }
+
+        return std::nullopt;
+    }
+
+private:
+    static constexpr int MaxAmount = 5;
+
+    std::vector<int> amounts;
+    size_t hand = 0;
+};
+
+/** Full 2Q policy (Johnson, Shasha).
+  * New keys enter the A1in FIFO, hits there do not promote them. Keys evicted from A1in are remembered
+  * in the A1out ghost list, and only a key that comes back while still in A1out enters the Am LRU.
+  * A single pass over many pages (table scan) cycles through A1in and never pushes hot pages out of Am.
+  */
+template <class Key>
+class TwoQueueReplacementPolicy : public IReplacementPolicy<Key>
+{
+public:
+    explicit TwoQueueReplacementPolicy(size_t size)
+        : slots(size), max_in_size(std::max<size_t>(1, size / 4)), max_out_size(std::max<size_t>(1, size / 2))
+    {
+    }
+
+    void onHit(size_t slot) override
+    {
+        auto & state = slots[slot];
+        if (state.queue == Queue::am) {
+            am.splice(am.begin(), am, state.position);
+        }
+    }
+
+    void onInsert(size_t slot, const Key & key) override
+    {
+        auto & state = slots[slot];
+        auto ghost = a1out_positions.find(key);
+        if (ghost != a1out_positions.end()) {
+            a1out.erase(ghost->second);
+            a1out_positions.erase(ghost);
+            state.queue = Queue::am;
+            state.position = am.insert(am.begin(), slot);
+        } else {
+            state.queue = Queue::a1in;
+            state.position = a1in.insert(a1in.begin(), slot);
+        }
+    }
+
+    void onEvict(size_t slot, const Key & key) override
+    {
+        auto & state = slots[slot];
+        if (state.queue == Queue::a1in) {
+            a1in.erase(state.position);
+            rememberEvicted(key);
+        } else if (state.queue == Queue::am) {
+            am.erase(state.position);
+        }
+        state.queue = Queue::none;
+    }
+
+    std::optional<size_t> pickVictim(const std::vector<int> & pins) override
+    {
+        if (a1in.size() > max_in_size) {
+            if (auto victim = findUnpinned(a1in, pins)) {
+                return victim;
+            }
+        }
+
+        if (auto victim = findUnpinned(am, pins)) {
+            return victim;
+        }
+
+        return findUnpinned(a1in, pins);
+    }
+
+private:
+    enum class Queue
+    {
+        none,
+        a1in,
+        am
+    };
+
+    struct SlotState
+    {
+        Queue queue = Queue::none;
+        std::list<size_t>::iterator position;
+    };
+
+    /// Oldest unpinned slot of the queue, queues keep the newest slot at the front.
+    static std::optional<size_t> findUnpinned(const std::list<size_t> & queue, const std::vector<int> & pins)
+    {
+        for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+            if (pins[*it] == 0) {
+                return *it;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void rememberEvicted(const Key & key)
+    {
+        if (a1out_positions.contains(key)) {
+            return;
+        }
+        if (a1out.size() >= max_out_size) {
+            a1out_positions.erase(a1out.back());
+            a1out.pop_back();
+        }
+        a1out.push_front(key);
+        a1out_positions[key] = a1out.begin();
+    }
+
+    std::vector<SlotState> slots;
+    std::list<size_t> a1in;
+    std::list<size_t> am;
+    std::list<Key> a1out;
+    std::unordered_map<Key, typename std::list<Key>::iterator> a1out_positions;
+    const size_t max_in_size;
+    const size_t max_out_size;
+};
+
+template <class Key>
+ReplacementPolicyPtr<Key> createReplacementPolicy(ReplacementPolicyType policy_type, size_t size)
+{
+    switch (policy_type)
+    {
+        case ReplacementPolicyType::clock:
+            return std::make_unique<ClockReplacementPolicy<Key>>(size);
+        case ReplacementPolicyType::two_queue:
+            return std::make_unique<TwoQueueReplacementPolicy<Key>>(size);
+    }
+
+    throw std::runtime_error("Unknown replacement policy");
+}
+
+}
@@ -1,8 +1,89 @@
 #include "scan.h"
 
+#include <algorithm>
+#include <chrono>
+
 namespace shdb
 {
 
-// Your code goes here.
+ReadAheadStatistics & getReadAheadStatistics()
+{
+    static ReadAheadStatistics statistics;
+    return statistics;
+}
+
+ReadAhead::ReadAhead(std::shared_ptr<ITable> table_, size_t window_, PageIndex end_page_index_)
+    : table(std::move(table_)), window(window_), end_page_index(end_page_index_)
+{
+}
+
+ReadAhead::~ReadAhead()
+{
+    getReadAheadStatistics().wasted += prefetched_pages.size();
+    prefetched_pages.clear();
+    /// Futures returned by std::async wait for their tasks, so the table outlives every background read.
+    workers.clear();
+}
+
+std::shared_ptr<ITablePage> ReadAhead::getPage(PageIndex page_index)
+{
+    auto & statistics = getReadAheadStatistics();
+
+    std::shared_ptr<ITablePage> page;
+    auto it = prefetched_pages.find(page_index);
+    if (it != prefetched_pages.end()) {
+        page = it->second.get();
+        prefetched_pages.erase(it);
+        statistics.hits += 1;
+    } else {
+        page = table->getPage(page_index);
+    }
+
+    /// Pages behind the scan position will never be requested by a sequential scan.
+    while (!prefetched_pages.empty() && prefetched_pages.begin()->first < page_index) {
+        prefetched_pages.erase(prefetched_pages.begin());
+        statistics.wasted += 1;
+    }
+
+    bool sequential = last_page_index && *last_page_index + 1 == page_index;
+    last_page_index = page_index;
+    if (!sequential) {
+        return page;
+    }
+
+    next_page_index_to_prefetch = std::max(next_page_index_to_prefetch, page_index + 1);
+    size_t pages_ahead = next_page_index_to_prefetch - page_index - 1;
+    if (pages_ahead <= window / 2) {
+        auto to = static_cast<PageIndex>(std::min<size_t>(end_page_index, page_index + 1 + window));
+        if (next_page_index_to_prefetch < to) {
+            schedule(next_page_index_to_prefetch, to);
+            next_page_index_to_prefetch = to;
+        }
+    }
+
+    return page;
+}
+
+void ReadAhead::schedule(PageIndex from, PageIndex to)
+{
+    std::erase_if(workers, [](auto & worker) { return worker.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+
+    std::vector<std::promise<std::shared_ptr<ITablePage>>> promises(to - from);
+    for (size_t i = 0; i < promises.size(); ++i) {
+        prefetched_pages.emplace(from + i, promises[i].get_future());
+    }
+    getReadAheadStatistics().prefetched += promises.size();
+
+    workers.push_back(std::async(std::launch::async, [table = table, from, promises = std::move(promises)]() mutable
+    {
+        for (size_t i = 0; i < promises.size(); ++i) {
+            try {
+                promises[i].set_value(table->getPage(from + i));
+            } catch (...) {
+                promises[i].set_exception(std::current_exception());
+            }
+        }
+    }));
+}
 
 }
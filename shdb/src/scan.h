@@ -1,14 +1,62 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <limits>
+#include <map>
+#include <optional>
+#include <vector>
+
 #include "table.h"
 
 namespace shdb
 {
 
+struct ReadAheadStatistics
+{
+    /// Pages requested by read-ahead.
+    std::atomic<uint64_t> prefetched = 0;
+    /// Prefetched pages that the scan actually reached.
+    std::atomic<uint64_t> hits = 0;
+    /// Prefetched pages dropped before the scan reached them.
+    std::atomic<uint64_t> wasted = 0;
+};
+
+/// Process-wide read-ahead counters.
+ReadAheadStatistics & getReadAheadStatistics();
+
+/** Read-ahead for sequential page access.
+  * Once two consecutive pages are requested, the next |window| pages are read by a background task,
+  * and the window is refilled every time the scan has consumed half of it.
+  * Prefetched pages stay pinned until the scan reaches them or the read-ahead is destroyed.
+  * The table must support concurrent getPage calls.
+  */
+class ReadAhead
+{
+public:
+    ReadAhead(std::shared_ptr<ITable> table_, size_t window_, PageIndex end_page_index_);
+
+    ~ReadAhead();
+
+    std::shared_ptr<ITablePage> getPage(PageIndex page_index);
+
+private:
+    void schedule(PageIndex from, PageIndex to);
+
+    std::shared_ptr<ITable> table;
+    const size_t window;
+    const PageIndex end_page_index;
+    std::optional<PageIndex> last_page_index;
+    PageIndex next_page_index_to_prefetch = 0;
+    std::map<PageIndex, std::future<std::shared_ptr<ITablePage>>> prefetched_pages;
+    std::vector<std::future<void>> workers;
+};
+
 class ScanIterator
 {
 public:
-    ScanIterator(std::shared_ptr<ITable> table, PageIndex page_index, RowIndex row_index) : table(table), current_page_index(page_index), current_row_index(row_index)
+    ScanIterator(std::shared_ptr<ITable> table, PageIndex page_index, RowIndex row_index, std::shared_ptr<ReadAhead> read_ahead = nullptr)
+        : table(table), current_page_index(page_index), current_row_index(row_index), read_ahead(std::move(read_ahead))
     {
     }
 
@@ -19,7 +67,7 @@ public:
 
     Row getRow() 
     {  
-        return table->getRow(getRowId());
+        return getPage()->getRow(current_row_index);
     }
 
     Row operator*() 
@@ -39,42 +87,106 @@ public:
 
     ScanIterator & operator++() 
     {
-        if (current_row_index + 1 < table->getPage(current_page_index)->getRowCount()) {
+        if (current_row_index + 1 < getPage()->getRowCount()) {
             current_row_index += 1;
         } else {
             current_row_index = 0;
             current_page_index += 1;
+            current_page.reset();
         }
         return *this;
     }
 
+    /** Append live rows from the current position to the end of the current page, at most max_rows of them,
+      * and move the iterator past the consumed slots. The page is resolved once for the whole batch.
+      * Returns the number of appended rows, which is zero for a page without live rows.
+      */
+    size_t readRows(Rows & rows, size_t max_rows = std::numeric_limits<size_t>::max())
+    {
+        const auto & page = getPage();
+        RowIndex row_count = page->getRowCount();
+        size_t read_rows = 0;
+
+        while (current_row_index < row_count && read_rows < max_rows) {
+            Row row = page->getRow(current_row_index);
+            current_row_index += 1;
+            if (!row.empty()) {
+                rows.push_back(std::move(row));
+                read_rows += 1;
+            }
+        }
+
+        if (current_row_index >= row_count) {
+            current_row_index = 0;
+            current_page_index += 1;
+            current_page.reset();
+        }
+
+        return read_rows;
+    }
+
     std::shared_ptr<ITable> table;
     PageIndex current_page_index;
     RowIndex current_row_index;
 
+private:
+    /// The page under the iterator stays pinned until the iterator moves past it,
+    /// so without read-ahead a scan holds exactly one page of the buffer pool at a time.
+    const std::shared_ptr<ITablePage> & getPage()
+    {
+        if (!current_page) {
+            current_page = read_ahead ? read_ahead->getPage(current_page_index) : table->getPage(current_page_index);
+        }
+        return current_page;
+    }
+
+    std::shared_ptr<ITablePage> current_page;
+    std::shared_ptr<ReadAhead> read_ahead;
+
 };
 
 
 class Scan
 {
 public:
-    explicit Scan(std::shared_ptr<ITable> table) : table(table)
+    /// read_ahead_window is the number of pages to prefetch for sequential access, zero disables read-ahead.
+    explicit Scan(std::shared_ptr<ITable> table, size_t read_ahead_window = 0) : table(table), read_ahead_window(read_ahead_window)
+    {
+
+    }
+
+    /// Scan of pages [begin_page_index, end_page_index) only, e.g. a part of the table read by one of several threads.
+    Scan(std::shared_ptr<ITable> table, size_t read_ahead_window, PageIndex begin_page_index, PageIndex end_page_index)
+        : table(table), read_ahead_window(read_ahead_window), begin_page_index(begin_page_index), end_page_index(end_page_index)
     {
 
     }
 
     ScanIterator begin() const 
     {
-        return ScanIterator(table, 0, 0);
+        if (read_ahead_window == 0) {
+            return ScanIterator(table, begin_page_index, 0);
+        }
+        auto read_ahead = std::make_shared<ReadAhead>(table, read_ahead_window, getEndPageIndex());
+        return ScanIterator(table, begin_page_index, 0, std::move(read_ahead));
     }
 
     ScanIterator end() const 
     {
-        auto page_count = table->getPageCount();
-        return ScanIterator(table, page_count, 0);
+        return ScanIterator(table, getEndPageIndex(), 0);
     }
 
     std::shared_ptr<ITable> table;
+    size_t read_ahead_window;
+
+private:
+    PageIndex getEndPageIndex() const
+    {
+        return end_page_index ? *end_page_index : table->getPageCount();
+    }
+
+    PageIndex begin_page_index = 0;
+    std::optional<PageIndex> end_page_index;
 };
 
 }
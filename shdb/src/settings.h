@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+namespace shdb
+{
+
+/// Execution settings of one query.
+struct QuerySettings
+{
+    /// Bytes of input rows a join may keep in memory, once both inputs need more than half of it
+    /// they are partitioned into temporary tables. Zero means no limit.
+    size_t max_bytes_in_join = 0;
+
+    /// Bytes of input rows ORDER BY sorts in memory at once, larger inputs are sorted in runs
+    /// written to temporary tables and merged. Zero means no limit.
+    size_t max_bytes_in_sort = 0;
+
+    /// Bytes of groups GROUP BY keeps in memory, rows of groups that don't fit are partitioned into
+    /// temporary tables and aggregated partition by partition. Zero means no limit.
+    size_t max_bytes_in_group_by = 0;
+
+    /// Number of threads a single operator may use.
+    size_t max_threads = 1;
+
+    /// Pages of one table may be requested from several threads at once. Set it only if the buffer pool
+    /// behind ITable::getPage is thread-safe, e.g. built on ShardedClockCache, ClockCache is not.
+    bool concurrent_page_reads = false;
+
+    /// Pages table scans prefetch ahead of the scan position with a background task, zero disables read-ahead.
+    /// Read-ahead requests pages concurrently with the scan, so it is used only with concurrent_page_reads.
+    size_t read_ahead_window = 0;
+};
+
+}
@@ -0,0 +1,86 @@
+#include "spill.h"
+
+#include <atomic>
+#include <random>
+#include <string>
+
+#include <unistd.h>
+
+namespace shdb
+{
+
+namespace
+{
+
+std::filesystem::path generateTemporaryTableName()
+{
+    static const std::string process_prefix
+        = std::string(TemporaryTableNamePrefix) + std::to_string(getpid()) + "_" + std::to_string(std::random_device{}()) + "_";
+    static std::atomic<uint64_t> counter = 0;
+    return process_prefix + std::to_string(counter++);
+}
+
+size_t getValueSize(const Value & value)
+{
+    if (const auto * string = std::get_if<std::string>(&value)) {
+        return sizeof(Value) + string->capacity();
+    }
+    return sizeof(Value);
+}
+
+}
+
+TemporaryTable::TemporaryTable(std::shared_ptr<Database> db_, std::shared_ptr<Schema> schema_)
+    : db(std::move(db_)), schema(std::move(schema_)), name(generateTemporaryTableName())
+{
+    /// The table may belong to another process, it is never dropped here.
+    if (db->checkTableExists(name)) {
+        throw std::runtime_error("Temporary table " + name.string() + " already exists");
+    }
+    db->createTable(name, schema);
+    table = db->getTable(name, schema);
+}
+
+TemporaryTable::~TemporaryTable()
+{
+    table.reset();
+    try {
+        db->dropTable(name);
+    } catch (...) {
+        /// Destructor must not throw, the table is left behind under its unique name.
+    }
+}
+
+void TemporaryTable::insertRow(const Row & row)
+{
+    table->insertRow(row);
+    row_count += 1;
+}
+
+bool isTemporaryTableName(const std::string & name)
+{
+    return name.starts_with(TemporaryTableNamePrefix);
+}
+
+size_t estimateRowSize(const Row & row)
+{
+    size_t size = sizeof(Row);
+    for (const auto & value : row) {
+        size += getValueSize(value);
+    }
+    return size;
+}
+
+size_t getPartitionHash(const Row & key, size_t level)
+{
+    /// Finalizer of MurmurHash3, mixes the level into every bit of the result.
+    uint64_t hash = std::hash<Row>{}(key) + level * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "database.h"
+#include "row.h"
+#include "schema.h"
+#include "table.h"
+
+namespace shdb
+{
+
+/// Names starting with this prefix are reserved for temporary tables, queries can't create or drop such tables.
+static constexpr std::string_view TemporaryTableNamePrefix = "__shdb_tmp_";
+
+bool isTemporaryTableName(const std::string & name);
+
+/** Table for intermediate rows of one query, created under a reserved unique name and dropped on destruction.
+  * Names are unique per process and carry the process id and a random token, so processes sharing a directory
+  * never touch each other's tables.
+  * Rows are stored through the regular Store and FlexiblePage, so they take buffer pool frames only while being written or read.
+  */
+class TemporaryTable
+{
+public:
+    TemporaryTable(std::shared_ptr<Database> db_, std::shared_ptr<Schema> schema_);
+
+    ~TemporaryTable();
+
+    TemporaryTable(const TemporaryTable &) = delete;
+    TemporaryTable & operator=(const TemporaryTable &) = delete;
+
+    void insertRow(const Row & row);
+
+    size_t getRowCount() const { return row_count; }
+
+    const std::shared_ptr<ITable> & getTable() const { return table; }
+
+    const std::shared_ptr<Schema> & getSchema() const { return schema; }
+
+private:
+    std::shared_ptr<Database> db;
+    std::shared_ptr<Schema> schema;
+    std::filesystem::path name;
+    std::shared_ptr<ITable> table;
+    size_t row_count = 0;
+};
+
+using TemporaryTablePtr = std::unique_ptr<TemporaryTable>;
+
+/// Approximate number of bytes a row takes in memory, used to enforce memory budgets of operators.
+size_t estimateRowSize(const Row & row);
+
+/// Hash of key used to spread rows over spill partitions. Each level gives partitions independent of the other levels,
+/// so a partition that is still too big can be split again.
+size_t getPartitionHash(const Row & key, size_t level);
+
+}